@@ -0,0 +1,157 @@
+#ifndef DEVICE_METRICS_H
+#define DEVICE_METRICS_H
+
+/*
+ * The hottest device metrics, published by the device webhook into a small
+ * memory-mapped file. The page is guarded by a seqlock: the only writer makes
+ * the sequence odd while updating, readers retry until they copy the page
+ * with the same even sequence before and after. Readers need no syscalls
+ * once the page is mapped.
+ *
+ * The writer only polls its sources while the page is read: readers that
+ * map it writable stamp read_s, and the sources idle once the stamp is
+ * older than DEVICE_METRICS_LEASE_S. A reader that reads less often than
+ * every second sets read_interval_ms, the sources are polled as rarely.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "vendor_xml.h"
+
+#define DEVICE_METRICS_FILE "/var/device_metrics"
+#define DEVICE_METRICS_MAGIC 0x4d455452
+#define DEVICE_METRICS_VERSION 3
+#define DEVICE_METRICS_LEASE_S 30
+
+#define DEVICE_METRICS_NO_CA -1
+
+struct device_metrics {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    uint32_t updates;
+    // CLOCK_MONOTONIC milliseconds of the last update, the signal source
+    // stamps it on every poll even if nothing changed
+    uint64_t updated_ms;
+    // CLOCK_MONOTONIC seconds of the last read, written by the readers and
+    // not covered by the seqlock
+    uint32_t read_s;
+    // how often the readers read, 0 for the writer's default; written and
+    // guarded like read_s, the last reader that sets it wins
+    uint32_t read_interval_ms;
+
+    int32_t rssi;
+    int32_t rsrp;
+    int32_t rsrq;
+    int32_t sinr;
+    int32_t rscp;
+    int32_t ecio;
+    int32_t ul_bw;
+    int32_t dl_bw;
+    int32_t band;
+    // index of the aggregated cell or DEVICE_METRICS_NO_CA
+    int32_t ca;
+    // <mode> of the "device signal" reply
+    int32_t network_mode;
+    // -1 when unknown
+    int32_t clients;
+};
+
+// Tags of the "device signal" and "monitoring status" replies, see vendor_xml.h
+static const struct vendor_xml_tag DEVICE_SIGNAL_TAGS[] = {
+    {"rssi", offsetof(struct device_metrics, rssi)},
+    {"rsrp", offsetof(struct device_metrics, rsrp)},
+    {"rsrq", offsetof(struct device_metrics, rsrq)},
+    {"sinr", offsetof(struct device_metrics, sinr)},
+    {"rscp", offsetof(struct device_metrics, rscp)},
+    {"ecio", offsetof(struct device_metrics, ecio)},
+    {"ulbandwidth", offsetof(struct device_metrics, ul_bw)},
+    {"dlbandwidth", offsetof(struct device_metrics, dl_bw)},
+    {"band", offsetof(struct device_metrics, band)},
+    {"mode", offsetof(struct device_metrics, network_mode)},
+};
+
+static const struct vendor_xml_tag DEVICE_STATUS_TAGS[] = {
+    {"CurrentWifiUser", offsetof(struct device_metrics, clients)},
+};
+
+// Resets the signal fields to "unknown"
+static inline void device_metrics_clear_signal(struct device_metrics *metrics) {
+    metrics->rssi = metrics->rsrp = metrics->rsrq = metrics->sinr = metrics->rscp = metrics->ecio = 0;
+    metrics->ul_bw = metrics->dl_bw = metrics->band = 0;
+    metrics->ca = DEVICE_METRICS_NO_CA;
+    metrics->network_mode = -1;
+}
+
+static inline uint64_t device_metrics_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Stamps the page as read. Returns 1 if the writer could have idled since
+// the previous read, its values may be old then.
+static inline int device_metrics_mark_read(struct device_metrics *page) {
+    uint32_t now_s = device_metrics_now_ms() / 1000;
+    uint32_t read_s = __atomic_load_n(&page->read_s, __ATOMIC_RELAXED);
+
+    if (read_s != now_s) {
+        __atomic_store_n(&page->read_s, now_s, __ATOMIC_RELAXED);
+    }
+    return read_s == 0 || now_s - read_s >= DEVICE_METRICS_LEASE_S;
+}
+
+// See read_interval_ms
+static inline void device_metrics_set_read_interval(struct device_metrics *page, uint32_t interval_ms) {
+    if (__atomic_load_n(&page->read_interval_ms, __ATOMIC_RELAXED) != interval_ms) {
+        __atomic_store_n(&page->read_interval_ms, interval_ms, __ATOMIC_RELAXED);
+    }
+}
+
+// Whether a reader stamped the page within the lease, see device_metrics_mark_read()
+static inline int device_metrics_has_readers(const struct device_metrics *page) {
+    uint32_t now_s = device_metrics_now_ms() / 1000;
+    uint32_t read_s = __atomic_load_n(&page->read_s, __ATOMIC_RELAXED);
+
+    return read_s != 0 && now_s - read_s < DEVICE_METRICS_LEASE_S;
+}
+
+static inline void device_metrics_write_begin(struct device_metrics *page) {
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void device_metrics_write_end(struct device_metrics *page) {
+    page->updates += 1;
+    page->updated_ms = device_metrics_now_ms();
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Copies a consistent snapshot. Returns 0 on success, -1 if the page is not
+// initialized or the writer kept it busy for all the retries.
+static inline int device_metrics_read(const struct device_metrics *page, struct device_metrics *out) {
+    const int MAX_RETRIES = 1000;
+
+    for (int i = 0; i < MAX_RETRIES; i += 1) {
+        uint32_t seq_before = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq_before & 1) {
+            continue;
+        }
+
+        memcpy(out, (const void*) page, sizeof(*out));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq_before) {
+            if (out->magic != DEVICE_METRICS_MAGIC || out->version != DEVICE_METRICS_VERSION) {
+                return -1;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Dumps the device metrics page published by the device webhook.
+ *
+ * Prints "name=value" lines, so scripts can simply eval the output:
+ * eval $(/app/hijack/bin/device_metrics_dump)
+ *
+ * Given a field name prints only its value:
+ * /app/hijack/bin/device_metrics_dump rssi
+ *
+ * If nobody read the page lately, the webhook is left a couple of seconds to
+ * refresh it first.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "device_metrics.h"
+
+int main(int argc, char* argv[]) {
+    struct device_metrics metrics;
+    struct device_metrics *page;
+    int fd;
+
+    if (argc > 2) {
+        puts("Usage: device_metrics_dump [field]");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((fd = open(DEVICE_METRICS_FILE, O_RDWR)) == -1) {
+        perror("Can't open " DEVICE_METRICS_FILE);
+        exit(EXIT_FAILURE);
+    }
+    page = mmap(NULL, sizeof(struct device_metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("Can't map " DEVICE_METRICS_FILE);
+        exit(EXIT_FAILURE);
+    }
+
+    if (device_metrics_mark_read(page)) {
+        sleep(2);
+    }
+
+    if (device_metrics_read(page, &metrics) != 0) {
+        fprintf(stderr, "The metrics page is not ready\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct {
+        const char *name;
+        long long value;
+    } fields[] = {
+        {"rssi", metrics.rssi},
+        {"rsrp", metrics.rsrp},
+        {"rsrq", metrics.rsrq},
+        {"sinr", metrics.sinr},
+        {"rscp", metrics.rscp},
+        {"ecio", metrics.ecio},
+        {"ul_bw", metrics.ul_bw},
+        {"dl_bw", metrics.dl_bw},
+        {"band", metrics.band},
+        {"ca", metrics.ca},
+        {"network_mode", metrics.network_mode},
+        {"clients", metrics.clients},
+        {"updates", metrics.updates},
+        {"age_ms", device_metrics_now_ms() - metrics.updated_ms},
+    };
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (argc == 1) {
+            printf("%s=%lld\n", fields[i].name, fields[i].value);
+        } else if (strcmp(argv[1], fields[i].name) == 0) {
+            printf("%lld\n", fields[i].value);
+            return 0;
+        }
+    }
+
+    if (argc == 2) {
+        fprintf(stderr, "Unknown field %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
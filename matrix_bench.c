@@ -0,0 +1,123 @@
+/*
+ * Compares the Matrix animation blitted from the sprites of oled_matrix.c
+ * with the text rasterising it used to do, a tick and a paint per frame,
+ * on the color screen and on the small one.
+ *
+ * Usage: matrix_bench [frames]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oled.h"
+
+extern uint16_t secret_screen_buf[];
+extern struct lcd_screen secret_screen;
+
+void put_small_text(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t red, uint8_t green, uint8_t blue, char *text);
+void switch_to_small_screen_mode();
+
+void matrix_columns_init();
+void matrix_columns_tick();
+void matrix_columns_paint();
+
+// The columns as strings painted every frame, kept as the baseline
+static struct {
+    int x;
+    int y;
+    char str[16+1];
+    uint8_t green;
+    int speed; // pixels per tick
+} text_seq[20];
+
+static void text_init() {
+    for (int i = 0; i < 20; i += 1) {
+        text_seq[i].x = rand() % 128;
+        text_seq[i].y = rand() % 128;
+        int len = 8 + rand() % 8;
+        for (int j = 0; j < 16; j += 1) {
+            if (j%2 == 1) {
+                text_seq[i].str[j] = '\n';
+            } else {
+                if (j < len) {
+                    text_seq[i].str[j] = ' ' + rand() % 15;
+                } else {
+                    text_seq[i].str[j] = ' ';
+                }
+            }
+        }
+        text_seq[i].green = rand() % 256;
+        text_seq[i].speed = 2 + rand() % 8;
+    }
+}
+
+static void text_tick() {
+    for (int i = 0; i < 20; i += 1) {
+        text_seq[i].y = (text_seq[i].y + text_seq[i].speed) % 256;
+        if(text_seq[i].y > lcd_height && text_seq[i].y < lcd_height + 15) {
+            text_seq[i].x = rand() % lcd_width;
+        }
+    }
+}
+
+static void text_paint() {
+    for (int i = 0; i < 20; i += 1) {
+        put_small_text(text_seq[i].x, text_seq[i].y, lcd_width, 255, 0, text_seq[i].green, 0, text_seq[i].str);
+    }
+}
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double run(void (*tick)(), void (*paint)(), int frames) {
+    double start = now_us();
+
+    for (int frame = 0; frame < frames; frame += 1) {
+        memset(secret_screen_buf, 0, secret_screen.buf_len);
+        tick();
+        paint();
+    }
+    return (now_us() - start) / frames;
+}
+
+static void bench(const char *screen, int frames) {
+    static uint16_t text_frame[LCD_MAX_WIDTH * LCD_MAX_HEIGHT];
+
+    // the same columns from the same seed, so the first frames match
+    srand(1);
+    text_init();
+    memset(secret_screen_buf, 0, secret_screen.buf_len);
+    text_paint();
+    memcpy(text_frame, secret_screen_buf, secret_screen.buf_len);
+
+    srand(1);
+    matrix_columns_init();
+    memset(secret_screen_buf, 0, secret_screen.buf_len);
+    matrix_columns_paint();
+    int same = memcmp(text_frame, secret_screen_buf, secret_screen.buf_len) == 0;
+
+    double text_us = run(text_tick, text_paint, frames);
+    double sprite_us = run(matrix_columns_tick, matrix_columns_paint, frames);
+
+    printf("%s screen: text %.1f us/frame, sprites %.1f us/frame (%.1fx), first frame %s\n",
+           screen, text_us, sprite_us, text_us / sprite_us, same ? "identical" : "DIFFERENT");
+}
+
+int main(int argc, char *argv[]) {
+    int frames = argc > 1 ? atoi(argv[1]) : 20000;
+
+    if (frames < 1) {
+        frames = 1;
+    }
+
+    bench("color", frames);
+    switch_to_small_screen_mode();
+    bench("small", frames);
+    return 0;
+}
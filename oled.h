@@ -39,9 +39,130 @@ struct led_widget {
     void (*init)();
     void (*deinit)();
     void (*paint)();
+    // optional, the static part of the screen, painted once and reused
+    // until background_invalidate(), paint() draws over it
+    void (*paint_background)();
+    // the widget draws into the 8-bit indexed buffer, see indexed_flush()
+    int indexed_colors;
+    // paint() only draws what changed, the last frame is kept instead of
+    // restoring the background, see repaint_background()
+    int incremental;
+    // optional, the screen went off or back on. The timers that only
+    // animate it are stopped meanwhile and the others slowed down.
+    void (*lcd_sleep_handler)();
+    void (*lcd_wake_handler)();
     void (*menu_key_handler)();
     void (*power_key_handler)();
     uint32_t parent_idx;
 };
 
+// Off-screen pixels in the native format of the screen, see native_color().
+// The put_* functions draw into the layer between layer_begin and layer_end.
+struct lcd_layer {
+    uint8_t width;
+    uint8_t height;
+    uint32_t capacity;
+    uint16_t *buf;
+};
+
+#define LCD_LAYER(name, w, h) \
+    uint16_t name##_buf[(w) * (h)]; \
+    struct lcd_layer name = {(w), (h), (w) * (h), name##_buf}
+
+// A plot area and the scales of its axes, see oled_chart.c. The values
+// x_min..x_max and y_min..y_max map to the pixels x..x+width and y+height..y.
+struct chart {
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+    uint8_t height;
+    float x_min, x_max;
+    float y_min, y_max;
+    // the number of the ticks on the y axis, 0 for no axes
+    uint8_t y_ticks;
+    // the axes and the tick labels, drawn again only when the scale changes
+    struct lcd_layer *axes;
+    int axes_valid;
+};
+
+// A strip chart: every value of the series is a column, the newest one at
+// the right edge. The columns are kept in the layer and scrolled.
+struct chart_strip {
+    struct time_series *values;
+    struct lcd_layer *layer;
+    // values->pushed when the layer was updated
+    uint32_t pushed;
+    int valid;
+    // paints the pixels y_from..y_to of the column, in the layer coordinates
+    void (*put_column)(struct chart *chart, uint8_t x, uint8_t y_from, uint8_t y_to);
+};
+
+// A field of cells for the games, see oled_grid.c. The cells are numbered
+// row by row.
+#define GRID_MAX_CELLS (16 * 16)
+#define GRID_MAX_DIRTY 16
+
+struct grid {
+    uint8_t width;
+    uint8_t height;
+    uint32_t occupied[GRID_MAX_CELLS / 32];
+    // the free cells in any order and where every cell is in the list
+    uint16_t free_cells[GRID_MAX_CELLS];
+    uint16_t free_pos[GRID_MAX_CELLS];
+    uint16_t free_count;
+    // a snake, a ring buffer of the occupied cells from the tail to the head
+    uint16_t body[GRID_MAX_CELLS];
+    uint16_t body_head;
+    uint16_t body_len;
+    // the cells to repaint, all of them if all_dirty
+    uint16_t dirty[GRID_MAX_DIRTY];
+    uint8_t dirty_count;
+    uint8_t all_dirty;
+};
+
+// see oled_video.c
+struct video_stream_stats {
+    uint32_t received;
+    uint32_t presented;
+    // a frame was due, but the jitter buffer was empty
+    uint32_t underruns;
+    // the frames that arrived after they were due
+    uint32_t late;
+    // the oldest frames dropped because the jitter buffer was full
+    uint32_t dropped;
+    // the current presentation interval
+    uint32_t interval_us;
+    // of the compressed stream, 0 is the best
+    uint32_t quality;
+    // since the start, the connect is 0 for the clips
+    uint32_t connect_ms;
+    uint32_t first_frame_ms;
+};
+
+#define WEBHOOK_PUSH_BUF_SIZE 8192
+
+struct webhook_subscription {
+    int fd;
+    uint32_t len;
+    char buf[WEBHOOK_PUSH_BUF_SIZE];
+};
+
+// Ring of the last samples with running min/max/mean, see oled_series.c
+struct time_series {
+    float *values;
+    uint32_t *min_queue;
+    uint32_t *max_queue;
+    uint32_t capacity;
+    uint32_t pushed;
+    uint32_t min_head, min_tail;
+    uint32_t max_head, max_tail;
+    double sum;
+};
+
+#define TIME_SERIES(name, cap) \
+    float name##_values[cap]; \
+    uint32_t name##_min_queue[cap]; \
+    uint32_t name##_max_queue[cap]; \
+    struct time_series name = {name##_values, name##_min_queue, name##_max_queue, cap, 0, 0, 0, 0, 0, 0}
+
 #endif
@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+
+#include "oled.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+extern void put_line(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t red, uint8_t green, uint8_t blue);
+extern void put_small_text(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t red, uint8_t green, uint8_t blue, char *text);
+extern void layer_init(struct lcd_layer *layer, uint8_t width, uint8_t height);
+extern void layer_begin(struct lcd_layer *layer);
+extern void layer_end();
+extern void layer_scroll_left(struct lcd_layer *layer, uint8_t columns);
+extern void layer_composite(struct lcd_layer *layer, uint8_t x, uint8_t y);
+
+uint32_t series_count(struct time_series *s);
+float series_at(struct time_series *s, uint32_t age);
+uint32_t series_lttb(struct time_series *xs, struct time_series *ys, uint32_t threshold, uint32_t *ages);
+
+// ------------------------------ CHARTS ------------------------------------
+// The static parts of a chart, the axes with the tick labels, are rendered
+// once into a layer and blitted on every repaint. Only the series are drawn
+// every time.
+
+void chart_init(struct chart *chart, uint8_t x, uint8_t y, uint8_t width, uint8_t height) {
+    chart->x = x;
+    chart->y = y;
+    chart->width = width;
+    chart->height = height;
+    chart->axes_valid = 0;
+}
+
+void chart_set_scale(struct chart *chart, float x_min, float x_max, float y_min, float y_max) {
+    // the tick labels only depend on the y scale
+    if (chart->y_min != y_min || chart->y_max != y_max) {
+        chart->axes_valid = 0;
+    }
+    chart->x_min = x_min;
+    chart->x_max = x_max;
+    chart->y_min = y_min;
+    chart->y_max = y_max;
+}
+
+uint8_t chart_x(struct chart *chart, float val) {
+    val = MAX(chart->x_min, MIN(chart->x_max, val));
+    return chart->x + (int)((val - chart->x_min) / (chart->x_max - chart->x_min) * chart->width + 0.5);
+}
+
+uint8_t chart_y(struct chart *chart, float val) {
+    val = MAX(chart->y_min, MIN(chart->y_max, val));
+    return chart->y + chart->height - (int)((val - chart->y_min) / (chart->y_max - chart->y_min) * chart->height + 0.5);
+}
+
+// The value at the screen row, the inverse of chart_y
+float chart_y_value(struct chart *chart, uint8_t y) {
+    return chart->y_min + (float) (chart->y + chart->height - y) * (chart->y_max - chart->y_min) / chart->height;
+}
+
+// the height of the small font, the labels are centered on the ticks
+const uint8_t CHART_LABEL_HEIGHT = 14;
+
+// The y axis with the ticks left of the plot area and the labels left of it
+void chart_paint_axes(struct chart *chart) {
+    if (!chart->axes || chart->y_ticks < 2) {
+        return;
+    }
+
+    if (!chart->axes_valid) {
+        layer_init(chart->axes, chart->x + 1, chart->y + chart->height - 7 + CHART_LABEL_HEIGHT);
+        layer_begin(chart->axes);
+
+        uint8_t axis_x = chart->x - 1;
+        put_line(axis_x, chart->y - 2, axis_x, chart->y + chart->height + 2, 255, 255, 255);
+
+        for (int i = 0; i < chart->y_ticks; i += 1) {
+            float val = chart->y_min + (chart->y_max - chart->y_min) * i / (chart->y_ticks - 1);
+            uint8_t tick_y = chart_y(chart, val);
+            char tick_buf[32];
+
+            put_line(axis_x - 1, tick_y, axis_x + 1, tick_y, 255, 255, 255);
+            snprintf(tick_buf, sizeof(tick_buf), "%3d", (int) val);
+            put_small_text(0, tick_y - 7, chart->x - 1, CHART_LABEL_HEIGHT, 255, 255, 255, tick_buf);
+        }
+
+        layer_end();
+        chart->axes_valid = 1;
+    }
+
+    layer_composite(chart->axes, 0, 0);
+}
+
+// A line through the points (x, y) of two series pushed together, decimated
+// to a point per pixel column. The values below the minimums are gaps.
+void chart_paint_line(struct chart *chart, struct time_series *xs, struct time_series *ys,
+                      uint8_t red, uint8_t green, uint8_t blue) {
+    uint32_t ages[LCD_MAX_WIDTH];
+    uint32_t count = series_lttb(xs, ys, MIN(chart->width, LCD_MAX_WIDTH), ages);
+
+    for (uint32_t i = 0; i + 1 < count; i += 1) {
+        float x1 = series_at(xs, ages[i]);
+        float x2 = series_at(xs, ages[i + 1]);
+        float y1 = series_at(ys, ages[i]);
+        float y2 = series_at(ys, ages[i + 1]);
+
+        if (x1 < chart->x_min || x2 < chart->x_min || y1 < chart->y_min || y2 < chart->y_min) {
+            continue;
+        }
+
+        put_line(chart_x(chart, x1), chart_y(chart, y1), chart_x(chart, x2), chart_y(chart, y2), red, green, blue);
+    }
+}
+
+void chart_strip_reset(struct chart_strip *strip) {
+    strip->valid = 0;
+}
+
+// On new values the layer is scrolled and only the new columns are
+// rasterised. A column spans from its value to the previous one.
+void chart_paint_strip(struct chart *chart, struct chart_strip *strip) {
+    uint32_t count = series_count(strip->values);
+    uint32_t new_samples = strip->values->pushed - strip->pushed;
+    uint32_t columns = chart->width + 1;
+
+    if (!strip->valid || new_samples) {
+        layer_begin(strip->layer);
+        if (strip->valid && new_samples < columns) {
+            layer_scroll_left(strip->layer, new_samples);
+        } else {
+            layer_init(strip->layer, columns, chart->height + 1);
+            new_samples = columns;
+            strip->valid = 1;
+        }
+
+        for (uint32_t age = 0; age < new_samples && age + 1 < count; age += 1) {
+            uint8_t y = chart_y(chart, series_at(strip->values, age)) - chart->y;
+            uint8_t prev_y = chart_y(chart, series_at(strip->values, age + 1)) - chart->y;
+            uint8_t y_from = MIN(y, prev_y);
+            uint8_t y_to = MAX(y, prev_y);
+
+            if ((y_to - y_from) > 1) {
+                // more smooth lines
+                y_from += 1;
+            }
+            if ((y_to - y_from) > 2) {
+                // more smooth lines
+                y_to -= 1;
+            }
+
+            strip->put_column(chart, columns - 1 - age, y_from, y_to);
+        }
+        layer_end();
+
+        strip->pushed = strip->values->pushed;
+    }
+
+    layer_composite(strip->layer, chart->x, chart->y);
+}
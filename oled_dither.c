@@ -0,0 +1,109 @@
+#include <stdint.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+// ------------------------------ DITHERING ------------------------------
+// Gray and color buffers to the layout of the small screen: rows of bytes,
+// 8 pixels per byte, the leftmost in the highest bit. Ordered dithering
+// with the 8x8 Bayer matrix, so the gray levels stay readable and a still
+// picture does not flicker between the frames.
+
+// the Bayer matrix scaled to 0..255, a pixel is white above the threshold
+static const uint8_t DITHER_THRESHOLDS[8][8] = {
+    {  2, 130,  34, 162,  10, 138,  42, 170},
+    {194,  66, 226,  98, 202,  74, 234, 106},
+    { 50, 178,  18, 146,  58, 186,  26, 154},
+    {242, 114, 210,  82, 250, 122, 218,  90},
+    { 14, 142,  46, 174,   6, 134,  38, 166},
+    {206,  78, 238, 110, 198,  70, 230, 102},
+    { 62, 190,  30, 158,  54, 182,  22, 150},
+    {254, 126, 222,  94, 246, 118, 214,  86},
+};
+
+// The luma of the byte swapped RGB565 pixels, the format of the color screen.
+// In memory they are big endian: RRRRRGGG GGGBBBBB.
+void dither_gray_rgb565(const uint16_t *src, uint8_t *gray, uint32_t count) {
+    const uint8_t *bytes = (const uint8_t *) src;
+    uint32_t i = 0;
+
+#ifdef __ARM_NEON
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x2_t pixels = vld2_u8(&bytes[i * 2]);
+        uint8x8_t red = vand_u8(pixels.val[0], vdup_n_u8(0xf8));
+        uint8x8_t green = vorr_u8(vshl_n_u8(pixels.val[0], 5), vand_u8(vshr_n_u8(pixels.val[1], 3), vdup_n_u8(0x1c)));
+        uint8x8_t blue = vshl_n_u8(pixels.val[1], 3);
+
+        uint16x8_t luma = vmull_u8(red, vdup_n_u8(77));
+        luma = vmlal_u8(luma, green, vdup_n_u8(150));
+        luma = vmlal_u8(luma, blue, vdup_n_u8(29));
+        vst1_u8(&gray[i], vshrn_n_u16(luma, 8));
+    }
+#endif
+
+    for (; i < count; i += 1) {
+        uint8_t hi = bytes[i * 2];
+        uint8_t lo = bytes[i * 2 + 1];
+        uint32_t red = hi & 0xf8;
+        uint32_t green = (uint8_t) (hi << 5) | ((lo >> 3) & 0x1c);
+        uint32_t blue = (uint8_t) (lo << 3);
+
+        gray[i] = (red * 77 + green * 150 + blue * 29) >> 8;
+    }
+}
+
+// Averages the pairs of rows in place, the result is height / 2 rows
+void dither_gray_halve_rows(uint8_t *gray, uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height / 2; y += 1) {
+        const uint8_t *top = &gray[y * 2 * width];
+        const uint8_t *bottom = top + width;
+        uint8_t *out = &gray[y * width];
+        uint32_t x = 0;
+
+#ifdef __ARM_NEON
+        for (; x + 16 <= width; x += 16) {
+            vst1q_u8(&out[x], vrhaddq_u8(vld1q_u8(&top[x]), vld1q_u8(&bottom[x])));
+        }
+#endif
+
+        for (; x < width; x += 1) {
+            out[x] = (top[x] + bottom[x] + 1) >> 1;
+        }
+    }
+}
+
+// The width is a multiple of 8
+void dither_mono_gray(const uint8_t *gray, uint32_t width, uint32_t height, uint8_t *mono) {
+    for (uint32_t y = 0; y < height; y += 1) {
+        const uint8_t *row = &gray[y * width];
+        const uint8_t *thresholds = DITHER_THRESHOLDS[y % 8];
+        uint8_t *out = &mono[y * width / 8];
+        uint32_t x = 0;
+
+#ifdef __ARM_NEON
+        static const uint8_t BIT_WEIGHTS[8] = {128, 64, 32, 16, 8, 4, 2, 1};
+        uint8x8_t weights = vld1_u8(BIT_WEIGHTS);
+        uint8x8_t threshold = vld1_u8(thresholds);
+
+        // 64 pixels to 8 bytes, the weighted masks are summed pairwise
+        for (; x + 64 <= width; x += 64) {
+            uint8x8_t bits[8];
+            for (int i = 0; i < 8; i += 1) {
+                bits[i] = vand_u8(vcgt_u8(vld1_u8(&row[x + i * 8]), threshold), weights);
+            }
+            uint8x8_t low = vpadd_u8(vpadd_u8(bits[0], bits[1]), vpadd_u8(bits[2], bits[3]));
+            uint8x8_t high = vpadd_u8(vpadd_u8(bits[4], bits[5]), vpadd_u8(bits[6], bits[7]));
+            vst1_u8(&out[x / 8], vpadd_u8(low, high));
+        }
+#endif
+
+        for (; x < width; x += 8) {
+            uint8_t byte = 0;
+            for (int bit = 0; bit < 8; bit += 1) {
+                byte |= (row[x + bit] > thresholds[bit]) << (7 - bit);
+            }
+            out[x / 8] = byte;
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "oled.h"
+
+// ------------------------------ GRID ------------------------------------
+// The core of the grid games. The occupied cells are a bitmap and the free
+// ones a list with the position of every cell in it, so a cell is taken or
+// freed and a random free one is found in constant time. The changed cells
+// are collected for the repaint, a frame only redraws them.
+
+void grid_invalidate(struct grid *g) {
+    g->all_dirty = 1;
+    g->dirty_count = 0;
+}
+
+void grid_mark_dirty(struct grid *g, uint16_t cell) {
+    if (g->all_dirty) {
+        return;
+    }
+    if (g->dirty_count == GRID_MAX_DIRTY) {
+        grid_invalidate(g);
+        return;
+    }
+    g->dirty[g->dirty_count++] = cell;
+}
+
+void grid_init(struct grid *g, uint8_t width, uint8_t height) {
+    g->width = width;
+    g->height = height;
+
+    for (uint32_t i = 0; i < GRID_MAX_CELLS / 32; i += 1) {
+        g->occupied[i] = 0;
+    }
+    g->free_count = width * height;
+    for (uint16_t cell = 0; cell < g->free_count; cell += 1) {
+        g->free_cells[cell] = cell;
+        g->free_pos[cell] = cell;
+    }
+
+    g->body_head = GRID_MAX_CELLS - 1;
+    g->body_len = 0;
+    grid_invalidate(g);
+}
+
+// The cell at the position, -1 outside of the field
+int grid_cell(struct grid *g, int x, int y) {
+    if (x < 0 || x >= g->width || y < 0 || y >= g->height) {
+        return -1;
+    }
+    return y * g->width + x;
+}
+
+uint8_t grid_cell_x(struct grid *g, uint16_t cell) {
+    return cell % g->width;
+}
+
+uint8_t grid_cell_y(struct grid *g, uint16_t cell) {
+    return cell / g->width;
+}
+
+int grid_is_occupied(struct grid *g, uint16_t cell) {
+    return (g->occupied[cell / 32] >> (cell % 32)) & 1;
+}
+
+void grid_occupy(struct grid *g, uint16_t cell) {
+    if (grid_is_occupied(g, cell)) {
+        return;
+    }
+    g->occupied[cell / 32] |= 1u << (cell % 32);
+
+    // the last free cell takes its place in the list
+    uint16_t last = g->free_cells[--g->free_count];
+    g->free_cells[g->free_pos[cell]] = last;
+    g->free_pos[last] = g->free_pos[cell];
+    grid_mark_dirty(g, cell);
+}
+
+void grid_release(struct grid *g, uint16_t cell) {
+    if (!grid_is_occupied(g, cell)) {
+        return;
+    }
+    g->occupied[cell / 32] &= ~(1u << (cell % 32));
+
+    g->free_pos[cell] = g->free_count;
+    g->free_cells[g->free_count++] = cell;
+    grid_mark_dirty(g, cell);
+}
+
+// A random free cell, -1 if the field is full
+int grid_random_free(struct grid *g) {
+    if (g->free_count == 0) {
+        return -1;
+    }
+    return g->free_cells[rand() % g->free_count];
+}
+
+void grid_body_push_head(struct grid *g, uint16_t cell) {
+    g->body_head = (g->body_head + 1) % GRID_MAX_CELLS;
+    g->body[g->body_head] = cell;
+    g->body_len += 1;
+    grid_occupy(g, cell);
+}
+
+uint16_t grid_body_head(struct grid *g) {
+    return g->body[g->body_head];
+}
+
+void grid_body_pop_tail(struct grid *g) {
+    uint16_t tail = (g->body_head + GRID_MAX_CELLS - g->body_len + 1) % GRID_MAX_CELLS;
+
+    g->body_len -= 1;
+    grid_release(g, g->body[tail]);
+}
+
+// Calls paint_cell for the cells changed since the last call, or for all of
+// them after grid_invalidate()
+void grid_paint(struct grid *g, void (*paint_cell)(struct grid *g, uint16_t cell)) {
+    if (g->all_dirty) {
+        for (uint16_t cell = 0; cell < g->width * g->height; cell += 1) {
+            paint_cell(g, cell);
+        }
+    } else {
+        for (uint8_t i = 0; i < g->dirty_count; i += 1) {
+            paint_cell(g, g->dirty[i]);
+        }
+    }
+    g->all_dirty = 0;
+    g->dirty_count = 0;
+}
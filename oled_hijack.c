@@ -26,6 +26,8 @@ extern void dispatch_menu_key();
 
 extern void switch_to_small_screen_mode();
 
+extern void signal_sampler_start();
+
 /*
  * Real handlers from oled binary and libraries
  */
@@ -144,7 +146,10 @@ int register_notify_handler(int subsystemid, void *notify_handler_sync, void *no
     }
 
     notify_handler_async_real = notify_handler_async_orig;
-    return register_notify_handler_real(subsystemid, notify_handler_sync, notify_handler_async);
+    int result = register_notify_handler_real(subsystemid, notify_handler_sync, notify_handler_async);
+
+    signal_sampler_start();
+    return result;
 }
 
 int setuid(uid_t u) {
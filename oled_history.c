@@ -0,0 +1,354 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "oled.h"
+#include "signal_history.h"
+
+// ------------------------------ SIGNAL HISTORY ------------------------------
+// The only writer is the hijack library, the file outlives the widgets and
+// the restarts of the library, so the graphs have the data on entry.
+
+struct signal_history *signal_history = NULL;
+
+// CLOCK_MONOTONIC seconds, the time base of the file
+uint32_t signal_history_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static void history_reset(struct signal_history *h) {
+    memset(h, 0, sizeof(*h));
+    h->magic = SIGNAL_HISTORY_MAGIC;
+    h->version = SIGNAL_HISTORY_VERSION;
+    h->seconds_size = SIGNAL_HISTORY_SECONDS;
+    h->minutes_size = SIGNAL_HISTORY_MINUTES;
+    h->hours_size = SIGNAL_HISTORY_HOURS;
+}
+
+int signal_history_open() {
+    struct signal_history *h;
+
+    if (signal_history) {
+        return 0;
+    }
+
+    int fd = open(SIGNAL_HISTORY_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to open %s: %s\n", SIGNAL_HISTORY_FILE, strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(fd, sizeof(struct signal_history)) == -1) {
+        fprintf(stderr, "Failed to resize %s: %s\n", SIGNAL_HISTORY_FILE, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    h = mmap(NULL, sizeof(struct signal_history), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s: %s\n", SIGNAL_HISTORY_FILE, strerror(errno));
+        return -1;
+    }
+
+    if (h->magic != SIGNAL_HISTORY_MAGIC || h->version != SIGNAL_HISTORY_VERSION ||
+        h->seconds_size != SIGNAL_HISTORY_SECONDS || h->minutes_size != SIGNAL_HISTORY_MINUTES ||
+        h->hours_size != SIGNAL_HISTORY_HOURS || h->last_second > signal_history_now()) {
+        history_reset(h);
+    }
+
+    signal_history = h;
+    return 0;
+}
+
+void signal_history_close() {
+    if (signal_history) {
+        munmap(signal_history, sizeof(struct signal_history));
+        signal_history = NULL;
+    }
+}
+
+static void acc_reset(struct signal_rollup_acc *acc, uint32_t stamp) {
+    memset(acc, 0, sizeof(*acc));
+    acc->stamp = stamp;
+}
+
+static void acc_add(struct signal_rollup_acc *acc, int i, int32_t sum, uint32_t count, int16_t min, int16_t max) {
+    if (count == 0) {
+        return;
+    }
+    if (acc->counts[i] == 0 || min < acc->min[i]) {
+        acc->min[i] = min;
+    }
+    if (acc->counts[i] == 0 || max > acc->max[i]) {
+        acc->max[i] = max;
+    }
+    acc->sums[i] += sum;
+    acc->counts[i] += count;
+}
+
+static void acc_merge(struct signal_rollup_acc *acc, const struct signal_rollup_acc *from) {
+    for (int i = 0; i < SIGNAL_VALUES; i += 1) {
+        acc_add(acc, i, from->sums[i], from->counts[i], from->min[i], from->max[i]);
+    }
+    acc->samples += from->samples;
+    if (from->band) {
+        acc->band = from->band;
+    }
+}
+
+static void acc_to_rollup(const struct signal_rollup_acc *acc, struct signal_rollup *rollup) {
+    rollup->stamp = acc->stamp;
+    rollup->count = acc->samples;
+    rollup->band = acc->band;
+    for (int i = 0; i < SIGNAL_VALUES; i += 1) {
+        if (acc->counts[i]) {
+            rollup->min[i] = acc->min[i];
+            rollup->max[i] = acc->max[i];
+            rollup->avg[i] = acc->sums[i] / (int32_t) acc->counts[i];
+        } else {
+            rollup->min[i] = rollup->max[i] = rollup->avg[i] = 0;
+        }
+    }
+}
+
+static void history_flush_hour(struct signal_history *h) {
+    uint32_t hour = h->hour.stamp - 1;
+
+    acc_to_rollup(&h->hour, &h->hours[hour % SIGNAL_HISTORY_HOURS]);
+    h->hour.stamp = 0;
+}
+
+static void history_flush_minute(struct signal_history *h) {
+    uint32_t minute = h->minute.stamp - 1;
+    uint32_t hour = minute / 60;
+
+    acc_to_rollup(&h->minute, &h->minutes[minute % SIGNAL_HISTORY_MINUTES]);
+
+    if (h->hour.stamp && h->hour.stamp != hour + 1) {
+        history_flush_hour(h);
+    }
+    if (h->hour.stamp == 0) {
+        acc_reset(&h->hour, hour + 1);
+    }
+    acc_merge(&h->hour, &h->minute);
+    h->minute.stamp = 0;
+}
+
+// Stores the sample taken at the given second of signal_history_now(), the
+// samples older than the newest one are dropped. The unknown values are 0.
+void signal_history_add(uint32_t now, const int16_t values[SIGNAL_VALUES], int16_t band) {
+    struct signal_history *h = signal_history;
+    uint32_t minute = now / 60;
+
+    if (!h || now < h->last_second ||
+        (now == h->last_second && h->seconds[now % SIGNAL_HISTORY_SECONDS].stamp == now + 1)) {
+        return;
+    }
+
+    struct signal_sample *sample = &h->seconds[now % SIGNAL_HISTORY_SECONDS];
+    sample->stamp = now + 1;
+    memcpy(sample->values, values, sizeof(sample->values));
+    sample->band = band;
+    sample->reserved = 0;
+    h->last_second = now;
+
+    if (h->minute.stamp && h->minute.stamp != minute + 1) {
+        history_flush_minute(h);
+    }
+    if (h->minute.stamp == 0) {
+        acc_reset(&h->minute, minute + 1);
+    }
+
+    for (int i = 0; i < SIGNAL_VALUES; i += 1) {
+        if (values[i]) {
+            acc_add(&h->minute, i, values[i], 1, values[i], values[i]);
+        }
+    }
+    h->minute.samples += 1;
+    if (band) {
+        h->minute.band = band;
+    }
+}
+
+// The readers take the age from now in the units of the ring and return -1
+// if there is no data for that time. The minute and the hour in progress are
+// rolled up on the fly.
+
+int signal_history_second(uint32_t age, struct signal_sample *out) {
+    struct signal_history *h = signal_history;
+    uint32_t now = signal_history_now();
+
+    if (!h || age > now || age >= SIGNAL_HISTORY_SECONDS) {
+        return -1;
+    }
+
+    uint32_t second = now - age;
+    const struct signal_sample *sample = &h->seconds[second % SIGNAL_HISTORY_SECONDS];
+    if (sample->stamp != second + 1) {
+        return -1;
+    }
+    *out = *sample;
+    return 0;
+}
+
+int signal_history_minute(uint32_t age, struct signal_rollup *out) {
+    struct signal_history *h = signal_history;
+    uint32_t now = signal_history_now() / 60;
+
+    if (!h || age > now || age >= SIGNAL_HISTORY_MINUTES) {
+        return -1;
+    }
+
+    uint32_t minute = now - age;
+    if (h->minute.stamp == minute + 1) {
+        acc_to_rollup(&h->minute, out);
+        return 0;
+    }
+
+    const struct signal_rollup *rollup = &h->minutes[minute % SIGNAL_HISTORY_MINUTES];
+    if (rollup->stamp != minute + 1) {
+        return -1;
+    }
+    *out = *rollup;
+    return 0;
+}
+
+int signal_history_hour(uint32_t age, struct signal_rollup *out) {
+    struct signal_history *h = signal_history;
+    uint32_t now = signal_history_now() / 3600;
+
+    if (!h || age > now || age >= SIGNAL_HISTORY_HOURS) {
+        return -1;
+    }
+
+    uint32_t hour = now - age;
+    int in_progress = h->hour.stamp == hour + 1;
+    int minute_in_hour = h->minute.stamp && (h->minute.stamp - 1) / 60 == hour;
+
+    if (in_progress || minute_in_hour) {
+        struct signal_rollup_acc acc;
+
+        if (in_progress) {
+            acc = h->hour;
+        } else {
+            acc_reset(&acc, hour + 1);
+        }
+        if (minute_in_hour) {
+            acc_merge(&acc, &h->minute);
+        }
+        acc_to_rollup(&acc, out);
+        return 0;
+    }
+
+    const struct signal_rollup *rollup = &h->hours[hour % SIGNAL_HISTORY_HOURS];
+    if (rollup->stamp != hour + 1) {
+        return -1;
+    }
+    *out = *rollup;
+    return 0;
+}
+
+static void history_bucket_range(struct signal_history *h, struct signal_envelope *env,
+                                 uint32_t from, uint32_t size, int16_t *min, int16_t *max) {
+    *min = *max = 0;
+
+    for (uint32_t t = from; t < from + size; t += 1) {
+        int16_t val_min, val_max;
+
+        if (env->minutes) {
+            const struct signal_rollup *rollup = &h->minutes[t % SIGNAL_HISTORY_MINUTES];
+
+            if (h->minute.stamp == t + 1 && h->minute.counts[env->value]) {
+                val_min = h->minute.min[env->value];
+                val_max = h->minute.max[env->value];
+            } else if (rollup->stamp == t + 1) {
+                val_min = rollup->min[env->value];
+                val_max = rollup->max[env->value];
+            } else {
+                continue;
+            }
+        } else {
+            const struct signal_sample *sample = &h->seconds[t % SIGNAL_HISTORY_SECONDS];
+
+            if (sample->stamp != t + 1) {
+                continue;
+            }
+            val_min = val_max = sample->values[env->value];
+        }
+
+        if (val_min == 0) {
+            continue;
+        }
+        if (*min == 0 || val_min < *min) {
+            *min = val_min;
+        }
+        if (*max == 0 || val_max > *max) {
+            *max = val_max;
+        }
+    }
+}
+
+// Decimates the last hour of samples or the last day of minute rollups to
+// the min/max per pixel column, column 0 is the newest one and 0 is "no data".
+// The columns are aligned to the time, so only the buckets that can still get
+// samples are scanned again, the finished ones come from the cache.
+int signal_history_envelope(struct signal_envelope *env, uint32_t columns, int16_t *mins, int16_t *maxs) {
+    struct signal_history *h = signal_history;
+
+    if (!h || columns == 0) {
+        return -1;
+    }
+
+    if (columns > SIGNAL_ENVELOPE_MAX_COLUMNS) {
+        columns = SIGNAL_ENVELOPE_MAX_COLUMNS;
+    }
+    if (env->columns != columns) {
+        memset(env->stamps, 0, sizeof(env->stamps));
+        env->columns = columns;
+    }
+
+    uint32_t span = env->minutes ? SIGNAL_HISTORY_MINUTES : SIGNAL_HISTORY_SECONDS;
+    // rounded up, so that the columns cover the whole span, the oldest one
+    // reaches past the history and is partly empty
+    uint32_t bucket_size = (span + columns - 1) / columns;
+    uint32_t now = signal_history_now();
+    uint32_t last = h->last_second;
+
+    if (env->minutes) {
+        now /= 60;
+        last /= 60;
+    }
+
+    // samples come in order, so the buckets before the newest sample are done
+    uint32_t newest_bucket = now / bucket_size;
+    uint32_t done_buckets = last / bucket_size;
+
+    for (uint32_t col = 0; col < columns; col += 1) {
+        if (col > newest_bucket) {
+            mins[col] = maxs[col] = 0;
+            continue;
+        }
+
+        uint32_t bucket = newest_bucket - col;
+        uint32_t slot = bucket % columns;
+
+        if (env->stamps[slot] != bucket + 1) {
+            history_bucket_range(h, env, bucket * bucket_size, bucket_size, &env->min[slot], &env->max[slot]);
+            env->stamps[slot] = bucket < done_buckets ? bucket + 1 : 0;
+        }
+        mins[col] = env->min[slot];
+        maxs[col] = env->max[slot];
+    }
+    return 0;
+}
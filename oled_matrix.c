@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "oled.h"
+
+extern void put_small_text(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t red, uint8_t green, uint8_t blue, char *text);
+extern uint16_t native_color(uint8_t red, uint8_t green, uint8_t blue);
+extern void layer_init(struct lcd_layer *layer, uint8_t width, uint8_t height);
+extern void layer_begin(struct lcd_layer *layer);
+extern void layer_end();
+extern void layer_blit_mask(struct lcd_layer *layer, int x, int y, uint16_t color);
+
+// ------------------------------ MATRIX ------------------------------------
+// The falling columns of glyphs. Every column is rendered once into a layer
+// and a frame only blits them in their colors. The positions the columns
+// restart at are drawn at init too, so the ticks do not call rand().
+
+const int MATRIX_COLUMNS = 20;
+const int MATRIX_GLYPHS = 8;
+// of the small font
+const int MATRIX_GLYPH_WIDTH = 16;
+const int MATRIX_GLYPH_HEIGHT = 14;
+const int MATRIX_X_POOL = 64;
+
+struct matrix_column {
+    int x;
+    // wraps at 256, the rows below it are drawn from the top
+    int y;
+    uint8_t green;
+    int speed; // pixels per tick
+    struct lcd_layer sprite;
+};
+
+struct matrix_column matrix_columns[MATRIX_COLUMNS];
+uint16_t matrix_sprite_bufs[MATRIX_COLUMNS][MATRIX_GLYPH_WIDTH * MATRIX_GLYPHS * MATRIX_GLYPH_HEIGHT];
+
+// the native color of every brightness
+uint16_t matrix_colors[256];
+uint8_t matrix_x_pool[MATRIX_X_POOL];
+uint32_t matrix_x_next = 0;
+
+// Shrinks the sprite to its widest glyph, the rows are packed to the new width
+static void matrix_trim_sprite(struct lcd_layer *sprite) {
+    uint8_t width = 0;
+
+    for (int row = 0; row < sprite->height; row += 1) {
+        for (int col = width; col < sprite->width; col += 1) {
+            if (sprite->buf[row * sprite->width + col]) {
+                width = col + 1;
+            }
+        }
+    }
+    if (width == 0) {
+        width = 1;
+    }
+
+    for (int row = 1; row < sprite->height; row += 1) {
+        memmove(&sprite->buf[row * width], &sprite->buf[row * sprite->width], width * sizeof(uint16_t));
+    }
+    sprite->width = width;
+}
+
+void matrix_columns_init() {
+    for (int i = 0; i < MATRIX_COLUMNS; i += 1) {
+        struct matrix_column *column = &matrix_columns[i];
+        char str[MATRIX_GLYPHS * 2 + 1];
+
+        column->x = rand() % 128;
+        column->y = rand() % 128;
+
+        // a glyph per line, 4 to 8 of them
+        int glyphs = (9 + rand() % 8) / 2;
+        for (int j = 0; j < glyphs; j += 1) {
+            str[j * 2] = ' ' + rand() % 15;
+            str[j * 2 + 1] = '\n';
+        }
+        str[glyphs * 2] = '\0';
+
+        column->green = rand() % 256;
+        column->speed = 2 + rand() % 8;
+
+        column->sprite.buf = matrix_sprite_bufs[i];
+        column->sprite.capacity = MATRIX_GLYPH_WIDTH * MATRIX_GLYPHS * MATRIX_GLYPH_HEIGHT;
+        layer_init(&column->sprite, MATRIX_GLYPH_WIDTH, glyphs * MATRIX_GLYPH_HEIGHT);
+        layer_begin(&column->sprite);
+        put_small_text(0, 0, MATRIX_GLYPH_WIDTH, glyphs * MATRIX_GLYPH_HEIGHT, 255, 255, 255, str);
+        layer_end();
+        matrix_trim_sprite(&column->sprite);
+    }
+
+    for (int green = 0; green < 256; green += 1) {
+        matrix_colors[green] = native_color(0, green, 0);
+    }
+    for (int i = 0; i < MATRIX_X_POOL; i += 1) {
+        matrix_x_pool[i] = rand() % lcd_width;
+    }
+}
+
+void matrix_columns_tick() {
+    for (int i = 0; i < MATRIX_COLUMNS; i += 1) {
+        struct matrix_column *column = &matrix_columns[i];
+
+        column->y = (column->y + column->speed) % 256;
+        if (column->y > lcd_height && column->y < lcd_height + 15) {
+            column->x = matrix_x_pool[matrix_x_next % MATRIX_X_POOL];
+            matrix_x_next += 1;
+        }
+    }
+}
+
+void matrix_columns_paint() {
+    for (int i = 0; i < MATRIX_COLUMNS; i += 1) {
+        struct matrix_column *column = &matrix_columns[i];
+        uint16_t color = matrix_colors[column->green];
+
+        layer_blit_mask(&column->sprite, column->x, column->y, color);
+        if (column->y + column->sprite.height > 256) {
+            layer_blit_mask(&column->sprite, column->x, column->y - 256, color);
+        }
+    }
+}
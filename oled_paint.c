@@ -1,4 +1,6 @@
 #define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -13,6 +15,33 @@ uint16_t secret_screen_buf[LCD_MAX_WIDTH*LCD_MAX_HEIGHT] = {};
 
 struct lcd_screen secret_screen = {1, 128, 1, 128, LCD_MAX_WIDTH*LCD_MAX_HEIGHT*sizeof(uint16_t), secret_screen_buf};
 
+// the saved screen buffer with the static part of the active widget
+uint16_t background_buf[LCD_MAX_WIDTH*LCD_MAX_HEIGHT] = {};
+int background_valid = 0;
+
+// palette indexes of the pixels in the indexed mode, see indexed_flush()
+uint8_t indexed_screen_buf[LCD_MAX_WIDTH*LCD_MAX_HEIGHT] = {};
+int indexed_mode = 0;
+
+const int PALETTE_SIZE = 256;
+// the native color as drawn and the native color on the screen, they differ
+// after palette_recolor()
+uint16_t palette_keys[PALETTE_SIZE];
+uint16_t palette_colors[PALETTE_SIZE];
+uint32_t palette_len = 0;
+int palette_overflow_logged = 0;
+
+// the last lookup, the lines, rects and texts are of a single color
+int palette_last_valid = 0;
+uint16_t palette_last_key = 0;
+uint8_t palette_last_index = 0;
+
+void palette_reset() {
+    palette_len = 0;
+    palette_last_valid = 0;
+    palette_overflow_logged = 0;
+}
+
 void switch_to_small_screen_mode() {
     if (is_small_screen == 1) {
         return;
@@ -27,6 +56,8 @@ void switch_to_small_screen_mode() {
     secret_screen.width = lcd_width;
     const int BITS_IN_BYTE = 8;
     secret_screen.buf_len = (lcd_width * lcd_height) / BITS_IN_BYTE;
+    background_valid = 0;
+    palette_reset();
 }
 
 void put_small_screen_pixel(uint8_t x, uint8_t y, uint8_t iswhite) {
@@ -53,17 +84,11 @@ void put_small_screen_pixel(uint8_t x, uint8_t y, uint8_t iswhite) {
     }
 }
 
-void put_pixel(uint8_t x, uint8_t y, uint8_t red, uint8_t green, uint8_t blue) {
-    if (x >= lcd_width || y >= lcd_height) {
-        return;
-    }
+// The pixel value for the screen: 0 or 1 for the monochrome one, the byte
+// swapped RGB565 otherwise
+uint16_t native_color(uint8_t red, uint8_t green, uint8_t blue) {
     if (is_small_screen) {
-        if (red || green || blue) {
-            put_small_screen_pixel(x, y, 1);
-        } else {
-            put_small_screen_pixel(x, y, 0);
-        }
-        return;
+        return red || green || blue;
     }
     // truncate
     red = red >> 3;
@@ -77,9 +102,91 @@ void put_pixel(uint8_t x, uint8_t y, uint8_t red, uint8_t green, uint8_t blue) {
     color = (color << 5) | blue;
 
     // swap for little endian hosts
+    return (color >> 8) | (color << 8);
+}
+
+// the layer the put_* functions draw into, the screen if NULL
+struct lcd_layer *paint_layer = NULL;
+
+// The entry drawn with the closest color, for the colors that do not fit.
+// The small screen never gets here, it has two colors.
+static uint32_t palette_nearest(uint16_t color) {
+    uint32_t best_idx = 0;
+    uint32_t best_distance = UINT32_MAX;
+
+    // back to RGB565, see native_color()
     color = (color >> 8) | (color << 8);
+    int red = color >> 11;
+    int green = (color >> 5) & 0x3f;
+    int blue = color & 0x1f;
+
+    for (uint32_t idx = 0; idx < palette_len; idx += 1) {
+        uint16_t key = (palette_keys[idx] >> 8) | (palette_keys[idx] << 8);
+        int d_red = red - (key >> 11);
+        // green has a bit more
+        int d_green = (green - ((key >> 5) & 0x3f)) / 2;
+        int d_blue = blue - (key & 0x1f);
+        uint32_t distance = d_red * d_red + d_green * d_green + d_blue * d_blue;
+
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_idx = idx;
+        }
+    }
+    return best_idx;
+}
+
+// The palette entry for the native color, a new one is added on the first
+// use. The colors that do not fit are drawn with the closest one.
+uint8_t palette_index(uint16_t color) {
+    if (palette_last_valid && palette_last_key == color) {
+        return palette_last_index;
+    }
+
+    uint32_t idx = 0;
+    while (idx < palette_len && palette_keys[idx] != color) {
+        idx += 1;
+    }
+
+    if (idx == palette_len) {
+        if (palette_len < PALETTE_SIZE) {
+            palette_keys[idx] = palette_colors[idx] = color;
+            palette_len += 1;
+        } else {
+            if (!palette_overflow_logged) {
+                fprintf(stderr, "More than %d colors in the indexed mode, the closest ones are used\n", PALETTE_SIZE);
+                palette_overflow_logged = 1;
+            }
+            idx = palette_nearest(color);
+        }
+    }
+
+    palette_last_valid = 1;
+    palette_last_key = color;
+    palette_last_index = idx;
+    return idx;
+}
+
+void put_pixel(uint8_t x, uint8_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (paint_layer) {
+        if (x < paint_layer->width && y < paint_layer->height) {
+            paint_layer->buf[y * paint_layer->width + x] = native_color(red, green, blue);
+        }
+        return;
+    }
+    if (x >= lcd_width || y >= lcd_height) {
+        return;
+    }
+    if (indexed_mode) {
+        indexed_screen_buf[y*LCD_MAX_WIDTH + x] = palette_index(native_color(red, green, blue));
+        return;
+    }
+    if (is_small_screen) {
+        put_small_screen_pixel(x, y, native_color(red, green, blue));
+        return;
+    }
     // secret_screen_buf[x*128 + y] = color;
-    secret_screen_buf[y*128 + x] = color;
+    secret_screen_buf[y*128 + x] = native_color(red, green, blue);
 }
 
 void put_line(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t red, uint8_t green, uint8_t blue) {
@@ -182,10 +289,236 @@ void put_large_text(uint8_t x, uint8_t y, uint8_t w, uint8_t h,
     put_text(x, y, w, h, red, green, blue, text, (uint8_t*) LARGE_FONT, LARGE_FONT_BYTES_PER_CHAR, LARGE_FONT_SIZE, LARGE_FONT_WIDTHS);
 }
 
-void put_raw_buffer(uint8_t* from, uint32_t len) {
-    if (len > lcd_height * lcd_width * sizeof(uint16_t)) {
-        len = lcd_height * lcd_width * sizeof(uint16_t);
+// Refreshes show the frame, a full buffer in the native format, instead of
+// secret_screen_buf until it is set back with NULL. The put_* functions
+// always draw into secret_screen_buf.
+void screen_set_buffer(uint16_t *frame) {
+    secret_screen.buf = frame ? frame : secret_screen_buf;
+}
+
+// ------------------------------ LAYERS ------------------------------------
+
+// Resizes the layer within its capacity and makes it black
+void layer_init(struct lcd_layer *layer, uint8_t width, uint8_t height) {
+    if ((uint32_t) width * height > layer->capacity) {
+        height = layer->capacity / width;
     }
+    layer->width = width;
+    layer->height = height;
+    memset(layer->buf, 0, width * height * sizeof(uint16_t));
+}
+
+void layer_begin(struct lcd_layer *layer) {
+    paint_layer = layer;
+}
+
+void layer_end() {
+    paint_layer = NULL;
+}
 
-    memcpy(secret_screen_buf, from, len);
+// Moves the pixels left by the given number of columns, the freed columns
+// on the right are black
+void layer_scroll_left(struct lcd_layer *layer, uint8_t columns) {
+    if (columns >= layer->width) {
+        memset(layer->buf, 0, layer->width * layer->height * sizeof(uint16_t));
+        return;
+    }
+
+    for (int y = 0; y < layer->height; y += 1) {
+        uint16_t *row = &layer->buf[y * layer->width];
+        memmove(row, row + columns, (layer->width - columns) * sizeof(uint16_t));
+        memset(row + layer->width - columns, 0, columns * sizeof(uint16_t));
+    }
+}
+
+// Copies the layer to the screen, black pixels included
+void layer_composite(struct lcd_layer *layer, uint8_t x, uint8_t y) {
+    uint8_t width = layer->width;
+    uint8_t height = layer->height;
+
+    if (x >= lcd_width || y >= lcd_height) {
+        return;
+    }
+    if (x + width > lcd_width) {
+        width = lcd_width - x;
+    }
+    if (y + height > lcd_height) {
+        height = lcd_height - y;
+    }
+
+    for (int row = 0; row < height; row += 1) {
+        uint16_t *from = &layer->buf[row * layer->width];
+
+        if (indexed_mode) {
+            uint8_t *to = &indexed_screen_buf[(y + row) * LCD_MAX_WIDTH + x];
+            for (int col = 0; col < width; col += 1) {
+                to[col] = palette_index(from[col]);
+            }
+        } else if (is_small_screen) {
+            for (int col = 0; col < width; col += 1) {
+                put_small_screen_pixel(x + col, y + row, from[col]);
+            }
+        } else {
+            memcpy(&secret_screen_buf[(y + row) * 128 + x], from, width * sizeof(uint16_t));
+        }
+    }
+}
+
+// Paints the pixels of the layer that are not black in the color, the
+// layer is a sprite then. Clipped to the screen, so x and y can be negative.
+void layer_blit_mask(struct lcd_layer *layer, int x, int y, uint16_t color) {
+    int from_row = y < 0 ? -y : 0;
+    int to_row = y + layer->height > lcd_height ? lcd_height - y : layer->height;
+    int from_col = x < 0 ? -x : 0;
+    int to_col = x + layer->width > lcd_width ? lcd_width - x : layer->width;
+    uint8_t index = indexed_mode ? palette_index(color) : 0;
+
+    for (int row = from_row; row < to_row; row += 1) {
+        uint16_t *from = &layer->buf[row * layer->width];
+
+        if (indexed_mode) {
+            uint8_t *to = &indexed_screen_buf[(y + row) * LCD_MAX_WIDTH];
+            for (int col = from_col; col < to_col; col += 1) {
+                if (from[col]) {
+                    to[x + col] = index;
+                }
+            }
+        } else if (is_small_screen) {
+            for (int col = from_col; col < to_col; col += 1) {
+                if (from[col]) {
+                    put_small_screen_pixel(x + col, y + row, color);
+                }
+            }
+        } else {
+            uint16_t *to = &secret_screen_buf[(y + row) * 128];
+            for (int col = from_col; col < to_col; col += 1) {
+                if (from[col]) {
+                    to[x + col] = color;
+                }
+            }
+        }
+    }
+}
+
+// ------------------------------ BACKGROUND ----------------------------------
+// The background is painted into the screen buffer with the usual put_*
+// functions and layers and saved as is, in the native format of the screen.
+// The next frames start from a copy of it instead of a black screen.
+
+void background_invalidate() {
+    background_valid = 0;
+}
+
+int background_is_valid() {
+    return background_valid;
+}
+
+void background_save() {
+    if (indexed_mode) {
+        memcpy(background_buf, indexed_screen_buf, lcd_width * lcd_height);
+    } else {
+        memcpy(background_buf, secret_screen_buf, secret_screen.buf_len);
+    }
+    background_valid = 1;
+}
+
+void background_restore() {
+    if (indexed_mode) {
+        memcpy(indexed_screen_buf, background_buf, lcd_width * lcd_height);
+    } else {
+        memcpy(secret_screen_buf, background_buf, secret_screen.buf_len);
+    }
+}
+
+// Puts back a part of the background, for the widgets that keep the frame
+void background_restore_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h) {
+    if (x >= lcd_width || y >= lcd_height) {
+        return;
+    }
+    if (x + w > lcd_width) {
+        w = lcd_width - x;
+    }
+    if (y + h > lcd_height) {
+        h = lcd_height - y;
+    }
+
+    for (int row = y; row < y + h; row += 1) {
+        if (indexed_mode) {
+            memcpy(&indexed_screen_buf[row * LCD_MAX_WIDTH + x], (uint8_t *) background_buf + row * LCD_MAX_WIDTH + x, w);
+        } else if (is_small_screen) {
+            // the bits of put_small_screen_pixel()
+            for (int col = x; col < x + w; col += 1) {
+                uint16_t word = background_buf[(row * lcd_width + col) / 16];
+                uint8_t remainder = col % 16;
+                uint8_t bit_num = remainder < 8 ? 7 - remainder : 15 - (remainder - 8);
+                put_small_screen_pixel(col, row, (word >> bit_num) & 1);
+            }
+        } else {
+            memcpy(&secret_screen_buf[row * 128 + x], &background_buf[row * 128 + x], w * sizeof(uint16_t));
+        }
+    }
+}
+
+// ------------------------------ INDEXED COLORS ------------------------------
+// The widgets with a few colors draw a byte per pixel, an index into the
+// palette, and the pixels are expanded to the screen buffer in one pass
+// before the refresh. The palette starts empty with every widget and gets
+// the colors as they are drawn.
+
+void indexed_set_mode(int enabled) {
+    indexed_mode = enabled;
+    palette_reset();
+}
+
+// Shows the pixels drawn in one color in another one, the whole screen
+// changes without a repaint after indexed_flush(). Later drawing in the old
+// color gets the new one too, until the widget is left. Returns 0 if
+// nothing was drawn in the color or the widget is not in the indexed mode.
+int palette_recolor(uint8_t red, uint8_t green, uint8_t blue,
+                    uint8_t new_red, uint8_t new_green, uint8_t new_blue) {
+    uint16_t key = native_color(red, green, blue);
+
+    if (!indexed_mode) {
+        return 0;
+    }
+    for (uint32_t idx = 0; idx < palette_len; idx += 1) {
+        if (palette_keys[idx] == key) {
+            palette_colors[idx] = native_color(new_red, new_green, new_blue);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Expands the indexes to the byte swapped RGB565 or packs them to 1 bit
+// per pixel for the small screen
+void indexed_flush() {
+    uint32_t pixels = lcd_width * lcd_height;
+
+    if (!indexed_mode) {
+        return;
+    }
+
+    if (is_small_screen) {
+        // 16 pixels per word, the bit order of put_small_screen_pixel()
+        for (uint32_t i = 0; i < pixels; i += 16) {
+            const uint8_t *from = &indexed_screen_buf[i];
+            uint16_t word = 0;
+
+            for (int bit = 0; bit < 8; bit += 1) {
+                word |= palette_colors[from[bit]] << (7 - bit);
+                word |= palette_colors[from[bit + 8]] << (15 - bit);
+            }
+            secret_screen_buf[i / 16] = word;
+        }
+        return;
+    }
+
+    // the rows are 128 pixels on both screens, so the buffers are contiguous
+    for (uint32_t i = 0; i < pixels; i += 4) {
+        secret_screen_buf[i] = palette_colors[indexed_screen_buf[i]];
+        secret_screen_buf[i + 1] = palette_colors[indexed_screen_buf[i + 1]];
+        secret_screen_buf[i + 2] = palette_colors[indexed_screen_buf[i + 2]];
+        secret_screen_buf[i + 3] = palette_colors[indexed_screen_buf[i + 3]];
+    }
 }
@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/sysinfo.h>
+
+#include "oled.h"
+#include "web_hook.h"
+#include "device_metrics.h"
+#include "signal_history.h"
+
+extern uint32_t (*timer_create_ex)(uint32_t, uint32_t, void (*)(), uint32_t);
+extern uint32_t (*timer_delete_ex)(uint32_t);
+
+int webhook_subscribe(struct webhook_subscription *sub, const char *sock_name, uint32_t interval_ms,
+                      const char *subsystem, const char *function, int reqtype, const char *data);
+void webhook_unsubscribe(struct webhook_subscription *sub);
+int webhook_is_subscribed(struct webhook_subscription *sub);
+int webhook_next_push(struct webhook_subscription *sub, char *out, uint32_t out_size);
+
+int signal_history_open();
+uint32_t signal_history_now();
+void signal_history_add(uint32_t now, const int16_t values[SIGNAL_VALUES], int16_t band);
+
+// ------------------------------ SIGNAL SAMPLER ------------------------------
+// Samples the signal in the background, whatever widget is active. The
+// cheapest working source is used: the metrics page of the device webhook
+// needs no syscalls, the webhook subscription costs a read per sample. No
+// process is spawned, the process slot belongs to the widgets, so without
+// the webhook there are no samples and the signal widget runs the client
+// itself. The latest metrics stay in memory for the widgets, the samples go
+// to the history file in batches.
+
+// the period in ms, 0 disables the sampler
+const char *SAMPLER_PERIOD_FILE = "/online/oled_sampler_period";
+const uint32_t SAMPLER_DEFAULT_PERIOD_MS = 1000;
+const uint32_t SAMPLER_MIN_PERIOD_MS = 250;
+
+// while the screen is off, the per second history gets gaps then and only
+// the minute rollups stay complete. The sources are asked to slow down too.
+const uint32_t SAMPLER_SLEEP_PERIOD_MS = 10000;
+
+const int SAMPLER_BATCH = 10;
+// the sources that failed are retried after this number of ticks
+const uint32_t SAMPLER_RETRY_TICKS = 30;
+
+// Back off when the 1 minute load average is above SAMPLER_MAX_LOAD or a
+// sample took more CPU time than the budget, a sample is taken every
+// sampler_backoff ticks then
+const uint32_t SAMPLER_MAX_LOAD = 3 * 65536;
+const uint32_t SAMPLER_CPU_BUDGET_US = 2000;
+const uint32_t SAMPLER_MAX_BACKOFF = 16;
+const uint32_t SAMPLER_LOAD_CHECK_SAMPLES = 10;
+
+uint32_t sampler_timer = 0;
+uint32_t sampler_period_ms = 0;
+// sampler_period_ms or the sleep period
+uint32_t sampler_current_period_ms = 0;
+uint32_t sampler_ticks = 0;
+uint32_t sampler_backoff = 1;
+uint32_t sampler_over_budget = 0;
+
+// the latest metrics, guarded by a seqlock like the page, see device_metrics.h
+struct device_metrics sampler_metrics = {.magic = DEVICE_METRICS_MAGIC, .version = DEVICE_METRICS_VERSION};
+
+struct device_metrics *sampler_page = NULL;
+uint32_t sampler_page_retry_tick = 0;
+// of the last sample taken from the page
+uint64_t sampler_page_updated_ms = 0;
+
+struct webhook_subscription sampler_sub = {.fd = -1};
+uint32_t sampler_sub_retry_tick = 0;
+char sampler_reply[WEBHOOK_PUSH_BUF_SIZE] = {0};
+
+struct vendor_xml_table sampler_signal_tags = VENDOR_XML_TABLE(DEVICE_SIGNAL_TAGS);
+
+struct signal_sample sampler_pending[SAMPLER_BATCH];
+int sampler_pending_count = 0;
+
+// Writes the pending samples to the history file
+void signal_sampler_flush() {
+    for (int i = 0; i < sampler_pending_count; i += 1) {
+        struct signal_sample *sample = &sampler_pending[i];
+        signal_history_add(sample->stamp - 1, sample->values, sample->band);
+    }
+    sampler_pending_count = 0;
+}
+
+// Copies the latest metrics. Returns 0 on success, -1 if there are no
+// samples yet.
+int signal_sampler_latest(struct device_metrics *out) {
+    if (device_metrics_read(&sampler_metrics, out) != 0 || out->updates == 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void sampler_publish(const struct device_metrics *metrics) {
+    device_metrics_write_begin(&sampler_metrics);
+    sampler_metrics.rssi = metrics->rssi;
+    sampler_metrics.rsrp = metrics->rsrp;
+    sampler_metrics.rsrq = metrics->rsrq;
+    sampler_metrics.sinr = metrics->sinr;
+    sampler_metrics.rscp = metrics->rscp;
+    sampler_metrics.ecio = metrics->ecio;
+    sampler_metrics.ul_bw = metrics->ul_bw;
+    sampler_metrics.dl_bw = metrics->dl_bw;
+    sampler_metrics.band = metrics->band;
+    sampler_metrics.ca = metrics->ca;
+    sampler_metrics.network_mode = metrics->network_mode;
+    sampler_metrics.clients = metrics->clients;
+    device_metrics_write_end(&sampler_metrics);
+
+    if (!metrics->rssi) {
+        return;
+    }
+
+    struct signal_sample *sample = &sampler_pending[sampler_pending_count];
+    sample->stamp = signal_history_now() + 1;
+    sample->values[SIGNAL_RSSI] = metrics->rssi;
+    sample->values[SIGNAL_RSRP] = metrics->rsrp;
+    sample->values[SIGNAL_RSRQ] = metrics->rsrq;
+    sample->values[SIGNAL_SINR] = metrics->sinr;
+    sample->band = metrics->band;
+    sampler_pending_count += 1;
+
+    if (sampler_pending_count == SAMPLER_BATCH) {
+        signal_sampler_flush();
+    }
+}
+
+// The webhook stamps the page on every poll of the signal, changed or not,
+// so a page that was not stamped since the last sample is stale: the webhook
+// is busy, idle or gone. Returns 0 for a fresh sample, 1 for a stale page
+// and -1 if there is no page.
+static int sampler_from_page(struct device_metrics *out) {
+    if (!sampler_page && sampler_ticks >= sampler_page_retry_tick) {
+        int fd = open(DEVICE_METRICS_FILE, O_RDWR | O_CLOEXEC);
+        if (fd != -1) {
+            // writable for the read stamps, see device_metrics_mark_read()
+            void *page = mmap(NULL, sizeof(struct device_metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (page != MAP_FAILED) {
+                sampler_page = page;
+            }
+        }
+        sampler_page_retry_tick = sampler_ticks + SAMPLER_RETRY_TICKS;
+    }
+
+    if (!sampler_page) {
+        return -1;
+    }
+    device_metrics_mark_read(sampler_page);
+    device_metrics_set_read_interval(sampler_page, sampler_current_period_ms);
+    if (device_metrics_read(sampler_page, out) != 0 || out->updates == 0) {
+        return -1;
+    }
+
+    // the first read has nothing to compare with, it may be from long ago
+    uint64_t last_updated_ms = sampler_page_updated_ms;
+    sampler_page_updated_ms = out->updated_ms;
+    if (!last_updated_ms || out->updated_ms == last_updated_ms) {
+        return 1;
+    }
+    return 0;
+}
+
+static int sampler_from_subscription(struct device_metrics *out) {
+    if (!webhook_is_subscribed(&sampler_sub) && sampler_ticks >= sampler_sub_retry_tick) {
+        sampler_reply[0] = 0;
+        webhook_subscribe(&sampler_sub, DEVICE_WEBHOOK_SOCK, sampler_current_period_ms, "device", "signal", 1, "1");
+        sampler_sub_retry_tick = sampler_ticks + SAMPLER_RETRY_TICKS;
+    }
+
+    if (!webhook_is_subscribed(&sampler_sub)) {
+        return -1;
+    }
+
+    // the reply is pushed only when it changes, the last one is still valid
+    webhook_next_push(&sampler_sub, sampler_reply, sizeof(sampler_reply));
+    if (!sampler_reply[0]) {
+        return -1;
+    }
+
+    device_metrics_clear_signal(out);
+    out->clients = -1;
+    vendor_xml_parse_ints(&sampler_signal_tags, sampler_reply, out);
+    return 0;
+}
+
+static uint64_t sampler_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sampler_adjust_backoff(uint32_t cpu_us) {
+    static uint32_t samples = 0;
+    struct sysinfo info;
+
+    if (cpu_us > SAMPLER_CPU_BUDGET_US) {
+        sampler_over_budget += 1;
+    }
+
+    samples += 1;
+    if (samples % SAMPLER_LOAD_CHECK_SAMPLES != 0) {
+        return;
+    }
+
+    int busy = sampler_over_budget > 0 || (sysinfo(&info) == 0 && info.loads[0] > SAMPLER_MAX_LOAD);
+    sampler_over_budget = 0;
+
+    if (busy && sampler_backoff < SAMPLER_MAX_BACKOFF) {
+        sampler_backoff *= 2;
+    } else if (!busy && sampler_backoff > 1) {
+        sampler_backoff /= 2;
+    }
+}
+
+static void sampler_tick() {
+    struct device_metrics metrics;
+
+    sampler_ticks += 1;
+    if (sampler_ticks % sampler_backoff != 0) {
+        return;
+    }
+
+    uint64_t cpu_start = sampler_cpu_us();
+
+    int page_result = sampler_from_page(&metrics);
+
+    if (page_result == 0 || (page_result == -1 && sampler_from_subscription(&metrics) == 0)) {
+        sampler_publish(&metrics);
+    }
+
+    sampler_adjust_backoff(sampler_cpu_us() - cpu_start);
+}
+
+static uint32_t sampler_read_period() {
+    FILE *f = fopen(SAMPLER_PERIOD_FILE, "r");
+    unsigned int period_ms;
+
+    if (!f) {
+        return SAMPLER_DEFAULT_PERIOD_MS;
+    }
+    if (fscanf(f, "%u", &period_ms) != 1) {
+        period_ms = SAMPLER_DEFAULT_PERIOD_MS;
+    }
+    fclose(f);
+
+    if (period_ms && period_ms < SAMPLER_MIN_PERIOD_MS) {
+        period_ms = SAMPLER_MIN_PERIOD_MS;
+    }
+    return period_ms;
+}
+
+void signal_sampler_start() {
+    if (sampler_timer) {
+        return;
+    }
+
+    sampler_period_ms = sampler_read_period();
+    if (!sampler_period_ms) {
+        return;
+    }
+    sampler_current_period_ms = sampler_period_ms;
+
+    signal_history_open();
+    sampler_timer = timer_create_ex(sampler_period_ms, 1, sampler_tick, 0);
+}
+
+// The page gets the new period with the next read, the subscription is
+// made again with it on the next tick
+static void sampler_set_period(uint32_t period_ms) {
+    if (!sampler_timer) {
+        return;
+    }
+    timer_delete_ex(sampler_timer);
+    sampler_current_period_ms = period_ms;
+    sampler_timer = timer_create_ex(period_ms, 1, sampler_tick, 0);
+
+    if (webhook_is_subscribed(&sampler_sub)) {
+        webhook_unsubscribe(&sampler_sub);
+        sampler_sub_retry_tick = sampler_ticks;
+    }
+}
+
+// Nobody looks at the signal while the screen is off, the samples are taken
+// less often
+void signal_sampler_lcd_sleep() {
+    if (sampler_period_ms < SAMPLER_SLEEP_PERIOD_MS) {
+        sampler_set_period(SAMPLER_SLEEP_PERIOD_MS);
+    }
+}
+
+void signal_sampler_lcd_wake() {
+    if (sampler_period_ms < SAMPLER_SLEEP_PERIOD_MS) {
+        sampler_set_period(sampler_period_ms);
+    }
+}
@@ -0,0 +1,152 @@
+#include <stdint.h>
+
+#include "oled.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+// ------------------------------ TIME SERIES ---------------------------------
+// Fixed capacity ring of samples. The newest sample has age 0. Min and max of
+// the window are kept with monotonic queues of sample numbers, the mean with
+// a running sum, so a push costs O(1) amortized whatever the capacity is.
+
+void series_clear(struct time_series *s) {
+    s->pushed = 0;
+    s->sum = 0;
+    s->min_head = s->min_tail = 0;
+    s->max_head = s->max_tail = 0;
+}
+
+uint32_t series_count(struct time_series *s) {
+    return s->pushed < s->capacity ? s->pushed : s->capacity;
+}
+
+static float series_value(struct time_series *s, uint32_t num) {
+    return s->values[num % s->capacity];
+}
+
+float series_at(struct time_series *s, uint32_t age) {
+    return series_value(s, s->pushed - 1 - age);
+}
+
+void series_push(struct time_series *s, float val) {
+    uint32_t num = s->pushed;
+
+    if (num >= s->capacity) {
+        uint32_t evicted = num - s->capacity;
+        s->sum -= series_value(s, evicted);
+
+        if (s->min_head != s->min_tail && s->min_queue[s->min_head % s->capacity] == evicted) {
+            s->min_head += 1;
+        }
+        if (s->max_head != s->max_tail && s->max_queue[s->max_head % s->capacity] == evicted) {
+            s->max_head += 1;
+        }
+    }
+
+    s->values[num % s->capacity] = val;
+    s->sum += val;
+    s->pushed += 1;
+
+    // the samples that can never be the min or the max again are dropped
+    while (s->min_head != s->min_tail &&
+           series_value(s, s->min_queue[(s->min_tail - 1) % s->capacity]) >= val) {
+        s->min_tail -= 1;
+    }
+    s->min_queue[s->min_tail % s->capacity] = num;
+    s->min_tail += 1;
+
+    while (s->max_head != s->max_tail &&
+           series_value(s, s->max_queue[(s->max_tail - 1) % s->capacity]) <= val) {
+        s->max_tail -= 1;
+    }
+    s->max_queue[s->max_tail % s->capacity] = num;
+    s->max_tail += 1;
+}
+
+float series_min(struct time_series *s) {
+    if (s->min_head == s->min_tail) {
+        return 0;
+    }
+    return series_value(s, s->min_queue[s->min_head % s->capacity]);
+}
+
+float series_max(struct time_series *s) {
+    if (s->max_head == s->max_tail) {
+        return 0;
+    }
+    return series_value(s, s->max_queue[s->max_head % s->capacity]);
+}
+
+float series_mean(struct time_series *s) {
+    uint32_t count = series_count(s);
+    return count ? s->sum / count : 0;
+}
+
+// Largest-Triangle-Three-Buckets decimation of the line (x, y) of two series
+// pushed together. Picks up to threshold samples that keep the shape of the
+// line and writes their ages, the oldest first. Returns their number.
+uint32_t series_lttb(struct time_series *xs, struct time_series *ys, uint32_t threshold, uint32_t *ages) {
+    uint32_t count = series_count(xs);
+
+    if (threshold >= count || threshold < 3) {
+        uint32_t picked = MIN(count, threshold);
+        for (uint32_t i = 0; i < picked; i += 1) {
+            // the newest sample is kept when the line is cut
+            ages[i] = picked - 1 - i;
+        }
+        return picked;
+    }
+
+    // samples are numbered from the oldest one here
+    #define LTTB_X(i) series_at(xs, count - 1 - (i))
+    #define LTTB_Y(i) series_at(ys, count - 1 - (i))
+
+    float bucket_size = (float) (count - 2) / (threshold - 2);
+    uint32_t picked = 0;
+    uint32_t a = 0;
+
+    ages[picked++] = count - 1;
+
+    for (uint32_t bucket = 0; bucket < threshold - 2; bucket += 1) {
+        uint32_t next_from = (uint32_t) ((bucket + 1) * bucket_size) + 1;
+        uint32_t next_to = MIN((uint32_t) ((bucket + 2) * bucket_size) + 1, count);
+        float avg_x = 0;
+        float avg_y = 0;
+
+        for (uint32_t i = next_from; i < next_to; i += 1) {
+            avg_x += LTTB_X(i);
+            avg_y += LTTB_Y(i);
+        }
+        if (next_to > next_from) {
+            avg_x /= next_to - next_from;
+            avg_y /= next_to - next_from;
+        }
+
+        uint32_t from = (uint32_t) (bucket * bucket_size) + 1;
+        uint32_t to = (uint32_t) ((bucket + 1) * bucket_size) + 1;
+        float a_x = LTTB_X(a);
+        float a_y = LTTB_Y(a);
+        float max_area = -1;
+        uint32_t max_area_i = from;
+
+        for (uint32_t i = from; i < to; i += 1) {
+            float area = (a_x - avg_x) * (LTTB_Y(i) - a_y) - (a_x - LTTB_X(i)) * (avg_y - a_y);
+            if (area < 0) {
+                area = -area;
+            }
+            if (area > max_area) {
+                max_area = area;
+                max_area_i = i;
+            }
+        }
+
+        a = max_area_i;
+        ages[picked++] = count - 1 - a;
+    }
+
+    #undef LTTB_X
+    #undef LTTB_Y
+
+    ages[picked++] = 0;
+    return picked;
+}
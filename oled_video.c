@@ -0,0 +1,692 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "oled.h"
+#include "video_codec.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+void dither_gray_rgb565(const uint16_t *src, uint8_t *gray, uint32_t count);
+void dither_gray_halve_rows(uint8_t *gray, uint32_t width, uint32_t height);
+void dither_mono_gray(const uint8_t *gray, uint32_t width, uint32_t height, uint8_t *mono);
+
+// ------------------------------ VIDEO STREAM ------------------------------
+// A thread reads the socket as the data arrives and decodes the frames into
+// a small jitter buffer. The widget timer takes them out at the pace of the
+// arrivals: a bit faster when the buffer fills up, a bit slower when it runs
+// low. So a late packet is absorbed by the buffer instead of a dropped tick.
+//
+// The frames are complete screen buffers, the one taken out is shown as is
+// until the next one, so the slots are the queued frames, the one being
+// received and the one on the screen.
+//
+// On a compressed stream the receiver also watches the link and asks the
+// server for a lower quality when it can not keep up, see below.
+//
+// A local clip is played by a thread that pushes its frames at the rate of
+// the video server instead, the rest is the same.
+//
+// A color stream or clip can be shown on the small screen, the frames are
+// dithered into the jitter buffer then.
+
+const int VIDEO_JITTER_FRAMES = 4;
+const int VIDEO_JITTER_SLOTS = VIDEO_JITTER_FRAMES + 2;
+// the fill the pacing keeps, the playback starts with this many frames
+const uint32_t VIDEO_JITTER_TARGET = 2;
+// no data for that long closes the stream
+const int VIDEO_DATA_TIMEOUT_MS = 3000;
+// the rate of the video server and of the clips
+const uint32_t VIDEO_DEFAULT_INTERVAL_US = 31000;
+const uint32_t VIDEO_MAX_INTERVAL_US = 1000000;
+
+pthread_t video_receiver_thread;
+int video_receiver_running = 0;
+int video_receiver_socket = -1;
+const uint8_t *video_clip_map = NULL;
+size_t video_clip_size = 0;
+// the receiver polls it too, a byte written wakes it up to exit
+int video_receiver_wakeup[2] = {-1, -1};
+
+// the receiver thread only
+struct video_codec video_stream_codec;
+uint32_t video_stream_frame_size = 0;
+// the reference of the delta frames
+uint16_t video_decode_buf[LCD_MAX_BUF_SIZE / sizeof(uint16_t)];
+// a color source on the small screen
+int video_dither = 0;
+uint16_t video_color_buf[VIDEO_MAX_WORDS];
+uint8_t video_gray_buf[VIDEO_MAX_WORDS];
+uint8_t video_packet_buf[VIDEO_MAX_PAYLOAD];
+uint64_t video_last_arrival_us = 0;
+uint64_t video_started_us = 0;
+
+// shared, guarded by the lock
+pthread_mutex_t video_jitter_lock = PTHREAD_MUTEX_INITIALIZER;
+uint16_t video_jitter_frames[VIDEO_JITTER_SLOTS][LCD_MAX_BUF_SIZE / sizeof(uint16_t)];
+// the slots of the queued frames from the oldest one
+int video_jitter_queue[VIDEO_JITTER_FRAMES];
+uint32_t video_jitter_head = 0;
+uint32_t video_jitter_count = 0;
+int video_fill_slot = -1;
+int video_shown_slot = -1;
+uint32_t video_arrival_interval_us = 0;
+int video_underrun_pending = 0;
+int video_receiver_failed = 0;
+struct video_stream_stats video_stats;
+
+// the timer thread only
+int video_playing = 0;
+uint64_t video_next_present_us = 0;
+
+static uint64_t video_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// A slot that is neither queued nor on the screen to receive the next frame
+static uint16_t *video_jitter_next_fill() {
+    pthread_mutex_lock(&video_jitter_lock);
+    for (int slot = 0; slot < VIDEO_JITTER_SLOTS; slot += 1) {
+        int used = slot == video_shown_slot;
+        for (uint32_t i = 0; i < video_jitter_count && !used; i += 1) {
+            used = video_jitter_queue[(video_jitter_head + i) % VIDEO_JITTER_FRAMES] == slot;
+        }
+        if (!used) {
+            video_fill_slot = slot;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&video_jitter_lock);
+
+    return video_jitter_frames[video_fill_slot];
+}
+
+// Queues the frame received into the fill slot
+static void video_jitter_push() {
+    uint64_t now = video_now_us();
+
+    pthread_mutex_lock(&video_jitter_lock);
+    if (video_jitter_count == VIDEO_JITTER_FRAMES) {
+        video_jitter_head = (video_jitter_head + 1) % VIDEO_JITTER_FRAMES;
+        video_jitter_count -= 1;
+        video_stats.dropped += 1;
+    }
+
+    uint32_t tail = (video_jitter_head + video_jitter_count) % VIDEO_JITTER_FRAMES;
+    video_jitter_queue[tail] = video_fill_slot;
+    video_jitter_count += 1;
+    video_stats.received += 1;
+
+    if (video_underrun_pending) {
+        video_stats.late += 1;
+    }
+    if (video_stats.received == 1) {
+        video_stats.first_frame_ms = (now - video_started_us) / 1000;
+    }
+
+    if (video_last_arrival_us) {
+        uint64_t interval = now - video_last_arrival_us;
+        if (interval > VIDEO_MAX_INTERVAL_US) {
+            interval = VIDEO_MAX_INTERVAL_US;
+        }
+        video_arrival_interval_us = (video_arrival_interval_us * 7 + interval) / 8;
+    }
+    video_last_arrival_us = now;
+    pthread_mutex_unlock(&video_jitter_lock);
+}
+
+// The color frame to the small screen, two rows of it to one
+static void video_dither_frame(const uint16_t *color, uint16_t *slot) {
+    dither_gray_rgb565(color, video_gray_buf, VIDEO_MAX_WORDS);
+    dither_gray_halve_rows(video_gray_buf, 128, 128);
+    dither_mono_gray(video_gray_buf, 128, 64, (uint8_t *) slot);
+}
+
+// Where a raw frame is received, see video_push_raw()
+static uint8_t *video_raw_fill() {
+    if (video_dither) {
+        return (uint8_t *) video_color_buf;
+    }
+    return (uint8_t *) video_jitter_next_fill();
+}
+
+static void video_push_raw() {
+    if (video_dither) {
+        video_dither_frame(video_color_buf, video_jitter_next_fill());
+    }
+    video_jitter_push();
+}
+
+// The frame in video_decode_buf into the jitter buffer, once there is one
+static void video_push_decoded() {
+    if (!video_stream_codec.has_keyframe) {
+        return;
+    }
+    if (video_dither) {
+        video_unpack(&video_stream_codec, video_decode_buf, video_color_buf);
+        video_dither_frame(video_color_buf, video_jitter_next_fill());
+    } else {
+        video_unpack(&video_stream_codec, video_decode_buf, video_jitter_next_fill());
+    }
+    video_jitter_push();
+}
+
+// ------------------------------ QUALITY ------------------------------
+// The link is measured over windows of a few seconds: the part of the time
+// spent receiving the payloads, about all of it when the data backs up, and
+// the underruns. A busy or starving window steps the quality down. When the
+// next quality up would fit by the busy time scaled by its cost for a few
+// windows in a row, it steps up. If that fails right away the wait before
+// the next try doubles.
+
+struct video_quality {
+    uint8_t depth;
+    uint8_t frame_step;
+    // the relative bits per second
+    uint8_t cost;
+};
+
+const struct video_quality VIDEO_COLOR_QUALITIES[] = {
+    {VIDEO_DEPTH_NATIVE, 1, 64},
+    {VIDEO_DEPTH_GRAY4, 1, 16},
+    {VIDEO_DEPTH_GRAY4, 2, 8},
+    {VIDEO_DEPTH_MONO, 2, 2},
+    {VIDEO_DEPTH_MONO, 4, 1},
+};
+const struct video_quality VIDEO_SMALL_QUALITIES[] = {
+    {VIDEO_DEPTH_NATIVE, 1, 4},
+    {VIDEO_DEPTH_NATIVE, 2, 2},
+    {VIDEO_DEPTH_NATIVE, 4, 1},
+};
+
+const uint64_t VIDEO_QUALITY_WINDOW_US = 2000000;
+// percents of the window
+const uint64_t VIDEO_QUALITY_BUSY_DOWN = 80;
+const uint64_t VIDEO_QUALITY_BUSY_UP = 50;
+const uint32_t VIDEO_QUALITY_UNDERRUNS_DOWN = 2;
+// windows before a step up
+const int VIDEO_QUALITY_MIN_HOLD = 3;
+const int VIDEO_QUALITY_MAX_HOLD = 30;
+
+// the receiver thread only
+const struct video_quality *video_qualities;
+int video_quality_count;
+int video_quality;
+uint64_t video_window_start_us;
+uint64_t video_window_busy_us;
+uint32_t video_window_underruns;
+int video_windows_at_quality;
+int video_good_windows;
+int video_quality_hold;
+int video_stepped_up;
+
+static void video_quality_reset(int small_screen) {
+    video_qualities = small_screen ? VIDEO_SMALL_QUALITIES : VIDEO_COLOR_QUALITIES;
+    video_quality_count = small_screen ? sizeof(VIDEO_SMALL_QUALITIES) / sizeof(VIDEO_SMALL_QUALITIES[0])
+                                       : sizeof(VIDEO_COLOR_QUALITIES) / sizeof(VIDEO_COLOR_QUALITIES[0]);
+    video_quality = 0;
+    video_window_start_us = 0;
+    video_windows_at_quality = 0;
+    video_good_windows = 0;
+    video_quality_hold = VIDEO_QUALITY_MIN_HOLD;
+    video_stepped_up = 0;
+}
+
+static void video_quality_set(int sock, int quality, uint64_t busy_percent) {
+    struct video_control control = {
+        .type = VIDEO_CONTROL_QUALITY,
+        .depth = video_qualities[quality].depth,
+        .frame_step = video_qualities[quality].frame_step,
+    };
+
+    // a message is much smaller than the socket buffer
+    if (send(sock, &control, sizeof(control), MSG_NOSIGNAL) != sizeof(control)) {
+        return;
+    }
+    fprintf(stderr, "Video: quality %d, link busy %d%%\n", quality, (int) busy_percent);
+
+    video_stepped_up = quality < video_quality;
+    video_quality = quality;
+    video_windows_at_quality = 0;
+    video_good_windows = 0;
+
+    pthread_mutex_lock(&video_jitter_lock);
+    video_stats.quality = quality;
+    pthread_mutex_unlock(&video_jitter_lock);
+}
+
+// Called after every packet with the time its payload took
+static void video_quality_update(int sock, uint64_t busy_us) {
+    uint64_t now = video_now_us();
+    uint32_t underruns;
+
+    pthread_mutex_lock(&video_jitter_lock);
+    underruns = video_stats.underruns;
+    pthread_mutex_unlock(&video_jitter_lock);
+
+    if (!video_window_start_us) {
+        video_window_start_us = now;
+        video_window_busy_us = 0;
+        video_window_underruns = underruns;
+    }
+    video_window_busy_us += busy_us;
+    if (now - video_window_start_us < VIDEO_QUALITY_WINDOW_US) {
+        return;
+    }
+
+    uint64_t busy_percent = video_window_busy_us * 100 / (now - video_window_start_us);
+    int starving = underruns - video_window_underruns >= VIDEO_QUALITY_UNDERRUNS_DOWN;
+    video_window_start_us = 0;
+
+    // the first window after a change still has the packets sent before it
+    video_windows_at_quality += 1;
+    if (video_windows_at_quality == 1) {
+        return;
+    }
+
+    if (busy_percent > VIDEO_QUALITY_BUSY_DOWN || starving) {
+        if (video_quality + 1 < video_quality_count) {
+            // the step up did not work out
+            if (video_stepped_up && video_windows_at_quality <= video_quality_hold) {
+                video_quality_hold = MIN(video_quality_hold * 2, VIDEO_QUALITY_MAX_HOLD);
+            } else {
+                video_quality_hold = VIDEO_QUALITY_MIN_HOLD;
+            }
+            video_quality_set(sock, video_quality + 1, busy_percent);
+        }
+        return;
+    }
+
+    if (video_quality == 0) {
+        return;
+    }
+    uint64_t next_busy = busy_percent * video_qualities[video_quality - 1].cost / video_qualities[video_quality].cost;
+    video_good_windows = next_busy < VIDEO_QUALITY_BUSY_UP ? video_good_windows + 1 : 0;
+    if (video_good_windows >= video_quality_hold) {
+        video_quality_set(sock, video_quality - 1, busy_percent);
+    }
+}
+
+// Returns 0 when the events are there, -1 on errors, timeouts and wakeups
+static int video_wait(int sock, short events) {
+    struct pollfd fds[2] = {
+        {.fd = sock, .events = events},
+        {.fd = video_receiver_wakeup[0], .events = POLLIN},
+    };
+    int ret;
+
+    do {
+        ret = poll(fds, 2, VIDEO_DATA_TIMEOUT_MS);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret <= 0 || fds[1].revents || (fds[0].revents & (POLLERR | POLLNVAL))) {
+        return -1;
+    }
+    return 0;
+}
+
+static int video_recv_full(int sock, void *buf, uint32_t size) {
+    uint32_t have = 0;
+
+    while (have < size) {
+        if (video_wait(sock, POLLIN) != 0) {
+            return -1;
+        }
+
+        ssize_t ret = recv(sock, (uint8_t *) buf + have, size - have, 0);
+        if (ret == 0) {
+            return -1;
+        }
+        if (ret == -1) {
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        have += ret;
+    }
+    return 0;
+}
+
+// Sends the hello once connected, a server that knows the compressed format
+// answers with the magic, see video_codec.h
+static void *video_receiver(void *arg) {
+    int sock = video_receiver_socket;
+    int error = 0;
+    socklen_t len = sizeof(error);
+    char magic[VIDEO_CODEC_MAGIC_LEN];
+
+    UNUSED(arg);
+
+    if (video_wait(sock, POLLOUT) != 0 || getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error) {
+        goto fatal_error;
+    }
+    pthread_mutex_lock(&video_jitter_lock);
+    video_stats.connect_ms = (video_now_us() - video_started_us) / 1000;
+    pthread_mutex_unlock(&video_jitter_lock);
+    if (send(sock, VIDEO_CODEC_MAGIC, VIDEO_CODEC_MAGIC_LEN, MSG_NOSIGNAL) != VIDEO_CODEC_MAGIC_LEN) {
+        goto fatal_error;
+    }
+    if (video_recv_full(sock, magic, sizeof(magic)) != 0) {
+        goto fatal_error;
+    }
+
+    if (memcmp(magic, VIDEO_CODEC_MAGIC, VIDEO_CODEC_MAGIC_LEN) != 0) {
+        // an old server, the bytes are the start of the first raw frame
+        uint32_t have = sizeof(magic);
+        uint8_t *frame = video_raw_fill();
+
+        memcpy(frame, magic, sizeof(magic));
+        while (video_recv_full(sock, frame + have, video_stream_frame_size - have) == 0) {
+            video_push_raw();
+            frame = video_raw_fill();
+            have = 0;
+        }
+        goto fatal_error;
+    }
+
+    for (;;) {
+        struct video_packet_header header;
+
+        if (video_recv_full(sock, &header, sizeof(header)) != 0 || header.length > VIDEO_MAX_PAYLOAD) {
+            break;
+        }
+        uint64_t payload_start = video_now_us();
+        if (video_recv_full(sock, video_packet_buf, header.length) != 0) {
+            break;
+        }
+        video_quality_update(sock, video_now_us() - payload_start);
+
+        // the deltas are skipped until the key frame of the new depth
+        if (header.depth != video_stream_codec.depth &&
+            video_codec_init(&video_stream_codec, video_stream_codec.small_screen, header.depth) != 0) {
+            fprintf(stderr, "Unsupported video depth %d\n", header.depth);
+            break;
+        }
+        if (video_decode(&video_stream_codec, header.type, video_packet_buf, header.length,
+                         video_decode_buf) != 0) {
+            fprintf(stderr, "Broken video packet of type %d\n", header.type);
+            break;
+        }
+        video_push_decoded();
+    }
+
+fatal_error:
+    pthread_mutex_lock(&video_jitter_lock);
+    video_receiver_failed = 1;
+    pthread_mutex_unlock(&video_jitter_lock);
+    return NULL;
+}
+
+// Returns -1 if woken up to exit
+static int video_sleep_until(uint64_t deadline_us) {
+    struct pollfd fds = {.fd = video_receiver_wakeup[0], .events = POLLIN};
+    uint64_t now;
+
+    while ((now = video_now_us()) < deadline_us) {
+        // rounded up, the schedule is absolute so the rate stays exact
+        int ret = poll(&fds, 1, (deadline_us - now + 999) / 1000);
+        if (ret == 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Loops the mmapped clip: raw frames or a compressed stream with the magic
+static void *video_clip_player(void *arg) {
+    int compressed = memcmp(video_clip_map, VIDEO_CODEC_MAGIC, VIDEO_CODEC_MAGIC_LEN) == 0;
+    size_t pos = compressed ? VIDEO_CODEC_MAGIC_LEN : 0;
+    uint64_t next_push_us = video_now_us();
+
+    UNUSED(arg);
+
+    for (;;) {
+        if (!compressed) {
+            if (pos + video_stream_frame_size > video_clip_size) {
+                pos = 0;
+            }
+            memcpy(video_raw_fill(), video_clip_map + pos, video_stream_frame_size);
+            video_push_raw();
+            pos += video_stream_frame_size;
+        } else {
+            struct video_packet_header header;
+
+            if (pos + sizeof(header) > video_clip_size) {
+                // the deltas are skipped if the clip does not start with a key frame
+                pos = VIDEO_CODEC_MAGIC_LEN;
+                video_codec_init(&video_stream_codec, video_stream_codec.small_screen, VIDEO_DEPTH_NATIVE);
+            }
+            memcpy(&header, video_clip_map + pos, sizeof(header));
+            pos += sizeof(header);
+
+            if (header.length > VIDEO_MAX_PAYLOAD || header.length > video_clip_size - pos) {
+                fprintf(stderr, "Truncated video clip\n");
+                break;
+            }
+            if (header.depth != video_stream_codec.depth &&
+                video_codec_init(&video_stream_codec, video_stream_codec.small_screen, header.depth) != 0) {
+                fprintf(stderr, "Unsupported video depth %d\n", header.depth);
+                break;
+            }
+            if (video_decode(&video_stream_codec, header.type, video_clip_map + pos, header.length,
+                             video_decode_buf) != 0) {
+                fprintf(stderr, "Broken video packet of type %d\n", header.type);
+                break;
+            }
+            pos += header.length;
+
+            // a frame per packet, also for the skipped ones
+            video_push_decoded();
+        }
+
+        next_push_us += VIDEO_DEFAULT_INTERVAL_US;
+        if (video_sleep_until(next_push_us) != 0) {
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&video_jitter_lock);
+    video_receiver_failed = 1;
+    pthread_mutex_unlock(&video_jitter_lock);
+    return NULL;
+}
+
+static int video_thread_start(void *(*routine)(void *), int small_screen, int color_source) {
+    if (pipe2(video_receiver_wakeup, O_CLOEXEC | O_NONBLOCK) == -1) {
+        fprintf(stderr, "Failed to create the video wakeup pipe: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // the stream is of the source, the jitter buffer of the screen
+    video_dither = small_screen && color_source;
+    video_codec_init(&video_stream_codec, small_screen && !color_source, VIDEO_DEPTH_NATIVE);
+    video_stream_frame_size = video_stream_codec.frame_words * sizeof(uint16_t);
+    video_last_arrival_us = 0;
+    video_started_us = video_now_us();
+    video_quality_reset(video_stream_codec.small_screen);
+
+    video_jitter_head = 0;
+    video_jitter_count = 0;
+    video_fill_slot = -1;
+    video_shown_slot = -1;
+    video_arrival_interval_us = VIDEO_DEFAULT_INTERVAL_US;
+    video_underrun_pending = 0;
+    video_receiver_failed = 0;
+    memset(&video_stats, 0, sizeof(video_stats));
+    video_playing = 0;
+
+    if (pthread_create(&video_receiver_thread, NULL, routine, NULL) != 0) {
+        fprintf(stderr, "Failed to start the video receiver\n");
+        close(video_receiver_wakeup[0]);
+        close(video_receiver_wakeup[1]);
+        return -1;
+    }
+    video_receiver_running = 1;
+    return 0;
+}
+
+// Takes over the connecting socket, it is closed by video_stream_stop().
+// Returns -1 if the stream can not be started, the socket is not closed then.
+// With color_source the small screen shows the stream of the color one.
+int video_stream_start(int sock, int small_screen, int color_source) {
+    if (video_receiver_running) {
+        return -1;
+    }
+
+    video_receiver_socket = sock;
+    if (video_thread_start(video_receiver, small_screen, color_source) != 0) {
+        video_receiver_socket = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// Plays the clip in a loop until video_stream_stop()
+int video_clip_start(const char *path, int small_screen, int color_source) {
+    struct stat st;
+    void *map;
+
+    if (video_receiver_running) {
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to open the video clip %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < VIDEO_CODEC_MAGIC_LEN + (off_t) sizeof(struct video_packet_header)) {
+        fprintf(stderr, "The video clip %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays without the descriptor
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the video clip %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    // the raw clips are whole frames
+    uint32_t frame_size = small_screen && !color_source ? 128 * 64 / 8 : 128 * 128 * sizeof(uint16_t);
+    if (memcmp(map, VIDEO_CODEC_MAGIC, VIDEO_CODEC_MAGIC_LEN) != 0 && st.st_size < frame_size) {
+        fprintf(stderr, "The video clip %s is shorter than a frame\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    video_clip_map = map;
+    video_clip_size = st.st_size;
+    if (video_thread_start(video_clip_player, small_screen, color_source) != 0) {
+        munmap(map, st.st_size);
+        video_clip_map = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void video_stream_stop() {
+    if (!video_receiver_running) {
+        return;
+    }
+
+    if (write(video_receiver_wakeup[1], "", 1) != 1) {
+        // the receiver exits on the shutdown or on the timeout anyway
+        shutdown(video_receiver_socket, SHUT_RDWR);
+    }
+    pthread_join(video_receiver_thread, NULL);
+
+    close(video_receiver_wakeup[0]);
+    close(video_receiver_wakeup[1]);
+    if (video_receiver_socket != -1) {
+        close(video_receiver_socket);
+        video_receiver_socket = -1;
+    }
+    if (video_clip_map) {
+        munmap((void *) video_clip_map, video_clip_size);
+        video_clip_map = NULL;
+    }
+    video_receiver_running = 0;
+
+    fprintf(stderr, "Video: %u frames received, %u presented, %u underruns, %u late, %u dropped, quality %u\n",
+            video_stats.received, video_stats.presented, video_stats.underruns, video_stats.late,
+            video_stats.dropped, video_stats.quality);
+    fprintf(stderr, "Video: connected in %u ms, first frame in %u ms\n", video_stats.connect_ms,
+            video_stats.first_frame_ms);
+}
+
+int video_stream_failed() {
+    int failed;
+
+    pthread_mutex_lock(&video_jitter_lock);
+    failed = video_receiver_failed;
+    pthread_mutex_unlock(&video_jitter_lock);
+    return failed;
+}
+
+void video_stream_get_stats(struct video_stream_stats *out) {
+    pthread_mutex_lock(&video_jitter_lock);
+    *out = video_stats;
+    pthread_mutex_unlock(&video_jitter_lock);
+}
+
+// Returns the frame that is due, it stays valid until the next call or the
+// stop of the stream. NULL if it is not the time yet or the frame is late.
+uint16_t *video_stream_next_frame() {
+    uint64_t now = video_now_us();
+    uint16_t *frame = NULL;
+
+    pthread_mutex_lock(&video_jitter_lock);
+    if (!video_playing && video_jitter_count >= VIDEO_JITTER_TARGET) {
+        video_playing = 1;
+        video_next_present_us = now;
+    }
+
+    if (video_playing && now >= video_next_present_us) {
+        if (video_jitter_count == 0) {
+            if (!video_underrun_pending) {
+                video_stats.underruns += 1;
+                video_underrun_pending = 1;
+            }
+        } else {
+            video_shown_slot = video_jitter_queue[video_jitter_head];
+            frame = video_jitter_frames[video_shown_slot];
+            video_jitter_head = (video_jitter_head + 1) % VIDEO_JITTER_FRAMES;
+            video_jitter_count -= 1;
+            video_stats.presented += 1;
+
+            uint32_t interval = video_arrival_interval_us;
+            if (video_jitter_count > VIDEO_JITTER_TARGET) {
+                interval -= interval / 8;
+            } else if (video_jitter_count < VIDEO_JITTER_TARGET) {
+                interval += interval / 8;
+            }
+            video_stats.interval_us = interval;
+
+            // after an underrun or a stall of the timer the schedule starts over
+            if (video_underrun_pending || now > video_next_present_us + interval) {
+                video_next_present_us = now;
+            }
+            video_next_present_us += interval;
+            video_underrun_pending = 0;
+        }
+    }
+    pthread_mutex_unlock(&video_jitter_lock);
+
+    return frame;
+}
@@ -0,0 +1,119 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "oled.h"
+#include "web_hook.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+// ------------------------------ WEBHOOK SUBSCRIPTIONS --------------------
+// The webhook pushes "<length>\n<reply>" frames every time the reply changes,
+// so the readers never poll the vendor handlers themselves.
+
+void webhook_unsubscribe(struct webhook_subscription *sub) {
+    if (sub->fd != -1) {
+        close(sub->fd);
+        sub->fd = -1;
+    }
+    sub->len = 0;
+}
+
+int webhook_subscribe(struct webhook_subscription *sub, const char *sock_name, uint32_t interval_ms,
+                      const char *subsystem, const char *function, int reqtype, const char *data) {
+    struct sockaddr_un addr;
+    char req[256];
+
+    sub->fd = -1;
+    sub->len = 0;
+
+    int req_len = snprintf(req, sizeof(req), WEBHOOK_SUBSCRIBE "|%u|%s|%s|%d|%s\n",
+                           interval_ms, subsystem, function, reqtype, data);
+    if (req_len >= (int) sizeof(req)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, sock_name, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        write(fd, req, req_len) != req_len) {
+        fprintf(stderr, "Failed to subscribe to %s %s: %s\n", subsystem, function, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    sub->fd = fd;
+    return 0;
+}
+
+int webhook_is_subscribed(struct webhook_subscription *sub) {
+    return sub->fd != -1;
+}
+
+// Drains the socket without blocking and copies the newest complete reply to out.
+// Returns the reply length, or -1 if nothing new has arrived.
+int webhook_next_push(struct webhook_subscription *sub, char *out, uint32_t out_size) {
+    int latest_len = -1;
+
+    if (sub->fd == -1) {
+        return -1;
+    }
+
+    for (;;) {
+        ssize_t read_result = recv(sub->fd, sub->buf + sub->len,
+                                   WEBHOOK_PUSH_BUF_SIZE - sub->len, MSG_DONTWAIT);
+        if (read_result == 0 || (read_result < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            fprintf(stderr, "Webhook subscription closed\n");
+            webhook_unsubscribe(sub);
+            return latest_len;
+        }
+        if (read_result > 0) {
+            sub->len += read_result;
+        }
+
+        uint32_t offset = 0;
+        for (;;) {
+            char *newline = memchr(sub->buf + offset, '\n', sub->len - offset);
+            if (!newline) {
+                break;
+            }
+            uint32_t header_len = newline - (sub->buf + offset) + 1;
+            uint32_t frame_len = strtoul(sub->buf + offset, NULL, 10);
+            if (header_len + frame_len > WEBHOOK_PUSH_BUF_SIZE) {
+                fprintf(stderr, "Webhook push is too large: %u\n", frame_len);
+                webhook_unsubscribe(sub);
+                return latest_len;
+            }
+            if (offset + header_len + frame_len > sub->len) {
+                break;
+            }
+
+            // older frames are simply overwritten by the newer ones
+            latest_len = MIN(frame_len, out_size - 1);
+            memcpy(out, sub->buf + offset + header_len, latest_len);
+            out[latest_len] = 0;
+            offset += header_len + frame_len;
+        }
+
+        memmove(sub->buf, sub->buf + offset, sub->len - offset);
+        sub->len -= offset;
+
+        if (read_result < 0) {
+            return latest_len;
+        }
+    }
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -12,6 +13,8 @@
 
 #include "oled.h"
 #include "oled_font.h"
+#include "device_metrics.h"
+#include "signal_history.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -25,7 +28,31 @@ extern void put_line(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t red
 extern void put_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t red, uint8_t green, uint8_t blue);
 extern void put_small_text(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t red, uint8_t green, uint8_t blue, char *text);
 extern void put_large_text(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t red, uint8_t green, uint8_t blue, char *text);
-extern void put_raw_buffer(uint8_t* from, uint32_t len);
+extern void screen_set_buffer(uint16_t *frame);
+extern void layer_init(struct lcd_layer *layer, uint8_t width, uint8_t height);
+extern void layer_begin(struct lcd_layer *layer);
+extern void layer_end();
+extern void layer_scroll_left(struct lcd_layer *layer, uint8_t columns);
+extern void layer_composite(struct lcd_layer *layer, uint8_t x, uint8_t y);
+extern void background_invalidate();
+extern int background_is_valid();
+extern void background_save();
+extern void background_restore();
+extern void background_restore_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h);
+extern void indexed_set_mode(int enabled);
+extern void indexed_flush();
+extern int palette_recolor(uint8_t red, uint8_t green, uint8_t blue,
+                           uint8_t new_red, uint8_t new_green, uint8_t new_blue);
+
+void chart_init(struct chart *chart, uint8_t x, uint8_t y, uint8_t width, uint8_t height);
+void chart_set_scale(struct chart *chart, float x_min, float x_max, float y_min, float y_max);
+uint8_t chart_y(struct chart *chart, float val);
+float chart_y_value(struct chart *chart, uint8_t y);
+void chart_paint_axes(struct chart *chart);
+void chart_paint_line(struct chart *chart, struct time_series *xs, struct time_series *ys,
+                      uint8_t red, uint8_t green, uint8_t blue);
+void chart_strip_reset(struct chart_strip *strip);
+void chart_paint_strip(struct chart *chart, struct chart_strip *strip);
 extern int get_bytes_num_fit_by_width(uint8_t x, uint8_t w, uint8_t *text, uint8_t* font_widths);
 
 extern uint32_t (*timer_create_ex)(uint32_t, uint32_t, void (*)(), uint32_t);
@@ -36,6 +63,47 @@ int create_process(char* command, void (*finish_callback)(int, char *));
 void destroy_process();
 void destroy_process_pooler();
 
+void series_clear(struct time_series *s);
+void series_push(struct time_series *s, float val);
+uint32_t series_count(struct time_series *s);
+float series_at(struct time_series *s, uint32_t age);
+float series_min(struct time_series *s);
+float series_max(struct time_series *s);
+float series_mean(struct time_series *s);
+uint32_t series_lttb(struct time_series *xs, struct time_series *ys, uint32_t threshold, uint32_t *ages);
+
+int signal_history_open();
+int signal_history_second(uint32_t age, struct signal_sample *out);
+int signal_history_envelope(struct signal_envelope *env, uint32_t columns, int16_t *mins, int16_t *maxs);
+
+void signal_sampler_flush();
+void signal_sampler_lcd_sleep();
+void signal_sampler_lcd_wake();
+int signal_sampler_latest(struct device_metrics *out);
+
+void matrix_columns_init();
+void matrix_columns_tick();
+void matrix_columns_paint();
+
+void grid_init(struct grid *g, uint8_t width, uint8_t height);
+void grid_invalidate(struct grid *g);
+void grid_mark_dirty(struct grid *g, uint16_t cell);
+int grid_cell(struct grid *g, int x, int y);
+uint8_t grid_cell_x(struct grid *g, uint16_t cell);
+uint8_t grid_cell_y(struct grid *g, uint16_t cell);
+int grid_is_occupied(struct grid *g, uint16_t cell);
+int grid_random_free(struct grid *g);
+void grid_body_push_head(struct grid *g, uint16_t cell);
+uint16_t grid_body_head(struct grid *g);
+void grid_body_pop_tail(struct grid *g);
+void grid_paint(struct grid *g, void (*paint_cell)(struct grid *g, uint16_t cell));
+
+int video_stream_start(int sock, int small_screen, int color_source);
+int video_clip_start(const char *path, int small_screen, int color_source);
+void video_stream_stop();
+int video_stream_failed();
+uint16_t *video_stream_next_frame();
+
 extern struct lcd_screen secret_screen;
 
 uint32_t active_widget = 0;
@@ -48,10 +116,20 @@ const uint32_t USER_CUSTOM_SCRIPT_IDX;
 uint32_t lcd_timer = 0;
 uint32_t lcd_state = LED_ON;
 
+// The callers repaint after it, that frame catches up with what was not
+// drawn while the screen was off
 void lcd_turn_on() {
     if (lcd_state != LED_ON) {
+        uint32_t was_asleep = lcd_state == LED_SLEEP;
+
         lcd_state = LED_ON;
         lcd_control_operate(lcd_state);
+        if (was_asleep) {
+            signal_sampler_lcd_wake();
+        }
+        if (was_asleep && widgets[active_widget].lcd_wake_handler) {
+            widgets[active_widget].lcd_wake_handler();
+        }
     }
 }
 
@@ -59,6 +137,25 @@ void lcd_turn_off() {
     if (lcd_state != LED_SLEEP) {
         lcd_state = LED_SLEEP;
         lcd_control_operate(lcd_state);
+        signal_sampler_lcd_sleep();
+        if (widgets[active_widget].lcd_sleep_handler) {
+            widgets[active_widget].lcd_sleep_handler();
+        }
+    }
+}
+
+// (Re)starts a repeating timer of a widget with the period
+void widget_timer_start(uint32_t *timer, uint32_t period_ms, void (*tick)()) {
+    if (*timer) {
+        timer_delete_ex(*timer);
+    }
+    *timer = timer_create_ex(period_ms, 1, tick, 0);
+}
+
+void widget_timer_stop(uint32_t *timer) {
+    if (*timer) {
+        timer_delete_ex(*timer);
+        *timer = 0;
     }
 }
 
@@ -75,11 +172,36 @@ void clear_screen() {
     put_rect(0, 0, lcd_width, lcd_height, 0, 0, 0);
 }
 
-void repaint() {
+void repaint_background() {
+    if (!widgets[active_widget].paint_background) {
+        clear_screen();
+        return;
+    }
+
+    if (background_is_valid()) {
+        if (!widgets[active_widget].incremental) {
+            background_restore();
+        }
+        return;
+    }
     clear_screen();
+    widgets[active_widget].paint_background();
+    background_save();
+}
+
+void repaint() {
+    // nothing is drawn for the dark screen, lcd_turn_on() is followed by a
+    // repaint
+    if (lcd_state == LED_SLEEP) {
+        return;
+    }
+
+    screen_set_buffer(NULL);
+    repaint_background();
     if(widgets[active_widget].paint) {
         widgets[active_widget].paint();
     }
+    indexed_flush();
     lcd_refresh_screen(&secret_screen);
 }
 
@@ -91,6 +213,8 @@ void enter_widget(uint32_t num) {
 
     // do not deinit active widget for better user experience
     active_widget = num;
+    background_invalidate();
+    indexed_set_mode(widgets[active_widget].indexed_colors);
     widgets[active_widget].init();
     reschedule_lcd_timer();
     lcd_turn_on();
@@ -106,6 +230,8 @@ void leave_widget() {
     destroy_process();
 
     active_widget = widgets[active_widget].parent_idx;
+    background_invalidate();
+    indexed_set_mode(widgets[active_widget].indexed_colors);
     reschedule_lcd_timer();
     lcd_turn_on();
     repaint();
@@ -164,6 +290,8 @@ char *main_lines[] = {
 };
 
 char main_lines_num = 14;
+// the item of the mobile signal widget, the sampled RSSI is shown next to it
+const int MAIN_SIGNAL_ITEM = 1;
 
 void main_init() {
     main_current_item = 0;
@@ -187,6 +315,14 @@ void main_paint() {
         }
 
         put_small_text(20, y, lcd_width, lcd_height, 255,255,255, cur_line);
+
+        // the latest signal from the background sampler
+        struct device_metrics metrics;
+        if (page_first_item + i == MAIN_SIGNAL_ITEM && signal_sampler_latest(&metrics) == 0 && metrics.rssi) {
+            char rssi_buf[16];
+            snprintf(rssi_buf, sizeof(rssi_buf), "%ddBm", metrics.rssi);
+            put_small_text(lcd_width - 42, y, lcd_width, lcd_height, 128, 128, 128, rssi_buf);
+        }
     }
 
     if (page_first_item + lines_per_page < main_lines_num) {
@@ -256,9 +392,18 @@ void main_menu_key_pressed() {
 // ---------------------------------- MOBILE SIGNAL --------------------------
 
 uint32_t mobile_timer = 0;
+const uint32_t MOBILE_TICK_MS = 1000;
+const uint32_t MOBILE_SLEEP_TICK_MS = 10000;
 
 uint8_t mobile_tab_num = 0;
 
+// the graph tabs go first, the text takes two tabs on small screens
+#define MOBILE_TAB_LIVE 0
+#define MOBILE_TAB_HOUR 1
+#define MOBILE_TAB_DAY 2
+#define MOBILE_TAB_TEXT 3
+#define MOBILE_TAB_TEXT2 4
+
 int32_t mobile_rssi = 0;
 int32_t mobile_rsrq = 0;
 int32_t mobile_rsrp = 0;
@@ -270,8 +415,22 @@ int32_t mobile_dl_bw = 0;
 int32_t mobile_band = 0;
 int32_t mobile_ca = -1;
 
-const int32_t MAX_LAST_RSSI = 128;
-int32_t last_rssi[MAX_LAST_RSSI] = {};
+// one sample per pixel column
+#define MAX_LAST_RSSI 128
+TIME_SERIES(last_rssi, MAX_LAST_RSSI);
+
+// RSSI from -105 to -51 dBm, the live graph is a strip chart of last_rssi
+struct chart mobile_chart;
+LCD_LAYER(mobile_strip_layer, LCD_MAX_WIDTH, LCD_MAX_HEIGHT);
+void mobile_strip_put_column(struct chart *chart, uint8_t x, uint8_t y_from, uint8_t y_to);
+struct chart_strip mobile_strip = {&last_rssi, &mobile_strip_layer, 0, 0, mobile_strip_put_column};
+
+// the sampler counter of the last sample on the graph
+uint32_t mobile_last_update = 0;
+
+// the tab and the rows of the background, see mobile_update_layout()
+uint32_t mobile_layout = 0;
+void mobile_update_layout();
 
 int mobile_parse_ca(char *buf) {
     char* saveptr = 0;
@@ -291,7 +450,46 @@ int mobile_parse_ca(char *buf) {
     return -1;
 }
 
+struct vendor_xml_table mobile_signal_tags = VENDOR_XML_TABLE(DEVICE_SIGNAL_TAGS);
+
+void mobile_parse_reply(char *buf) {
+    struct device_metrics metrics;
+
+    metrics.rssi = mobile_rssi;
+    metrics.rsrq = mobile_rsrq;
+    metrics.rsrp = mobile_rsrp;
+    metrics.sinr = mobile_sinr;
+    metrics.rscp = mobile_rscp;
+    metrics.ecio = mobile_ecio;
+    metrics.ul_bw = mobile_ul_bw;
+    metrics.dl_bw = mobile_dl_bw;
+    metrics.band = mobile_band;
+
+    if (vendor_xml_parse_ints(&mobile_signal_tags, buf, &metrics)) {
+        mobile_rssi = metrics.rssi;
+        mobile_rsrq = metrics.rsrq;
+        mobile_rsrp = metrics.rsrp;
+        mobile_sinr = metrics.sinr;
+        mobile_rscp = metrics.rscp;
+        mobile_ecio = metrics.ecio;
+        mobile_ul_bw = metrics.ul_bw;
+        mobile_dl_bw = metrics.dl_bw;
+        mobile_band = metrics.band;
+    }
+
+    char *ca_line = strstr(buf, "^LCACELL: ");
+    if (ca_line) {
+        char ca_buf[128] = {0};
+        strncpy(ca_buf, ca_line + strlen("^LCACELL: "), sizeof(ca_buf) - 1);
+        ca_buf[strcspn(ca_buf, "\r\n")] = 0;
+        mobile_ca = mobile_parse_ca(ca_buf);
+    }
+}
+
 void mobile_process_callback(int good, char *buf) {
+    struct device_metrics metrics;
+    int has_new_sample = 1;
+
     if (!good) {
         return;
     }
@@ -300,63 +498,41 @@ void mobile_process_callback(int good, char *buf) {
     mobile_ul_bw = mobile_dl_bw = mobile_band = 0;
     mobile_ca = -1;
 
-    char ca_buf[128] = {0};
-
-    int offset = 0;
-
-    while (buf[offset]) {
-        int32_t val;
-
-        if (sscanf(&buf[offset], "<rssi>&gt;=%ddBm</rssi>", &val) == 1) {
-            mobile_rssi = val;
-        } else if (sscanf(&buf[offset], "<rssi>&lt;=%ddBm</rssi>", &val) == 1) {
-            mobile_rssi = val;
-        } else if (sscanf(&buf[offset], "<rssi>%ddBm</rssi>", &val) == 1) {
-            mobile_rssi = val;
-        } else if (sscanf(&buf[offset], "<rsrq>%ddB</rsrq>", &val) == 1) {
-            mobile_rsrq = val;
-        } else if (sscanf(&buf[offset], "<rsrp>%ddBm</rsrp>", &val) == 1) {
-            mobile_rsrp = val;
-        } else if (sscanf(&buf[offset], "<sinr>%ddB</sinr>", &val) == 1) {
-            mobile_sinr = val;
-        } else if (sscanf(&buf[offset], "<rscp>%ddBm</rscp>", &val) == 1) {
-            mobile_rscp = val;
-        } else if (sscanf(&buf[offset], "<ecio>%ddB</ecio>", &val) == 1) {
-            mobile_ecio = val;
-        } else if (sscanf(&buf[offset], "<ulbandwidth>%dMHz</ulbandwidth>", &val) == 1) {
-            mobile_ul_bw = val;
-        } else if (sscanf(&buf[offset], "<dlbandwidth>%dMHz</dlbandwidth>", &val) == 1) {
-            mobile_dl_bw = val;
-        } else if (sscanf(&buf[offset], "<band>%d</band>", &val) == 1) {
-            mobile_band = val;
-        } else if (strncmp(&buf[offset], "^LCACELL: ", strlen("^LCACELL: ")) == 0) {
-            strncpy(ca_buf, &buf[offset + strlen("^LCACELL: ")], 128);
-            mobile_ca = mobile_parse_ca(ca_buf);
-        }
-
-        while(buf[offset] != 0 && buf[offset] != '\n') {
-            offset += 1;
-        }
+    // with the background sampler, only the CA info comes from the process
+    if (signal_sampler_latest(&metrics) == 0) {
+        mobile_rssi = metrics.rssi;
+        mobile_rsrq = metrics.rsrq;
+        mobile_rsrp = metrics.rsrp;
+        mobile_sinr = metrics.sinr;
+        mobile_rscp = metrics.rscp;
+        mobile_ecio = metrics.ecio;
+        mobile_ul_bw = metrics.ul_bw;
+        mobile_dl_bw = metrics.dl_bw;
+        mobile_band = metrics.band;
 
-        if(buf[offset] == '\n') {
-            offset += 1;
-        }
+        has_new_sample = metrics.updates != mobile_last_update;
+        mobile_last_update = metrics.updates;
     }
+    mobile_parse_reply(buf);
 
-    if (mobile_rssi) {
-        for(int i = MAX_LAST_RSSI - 1; i > 0; i -= 1) {
-            last_rssi[i] = last_rssi[i - 1];
-        }
-        last_rssi[0] = mobile_rssi;
+    if (mobile_rssi && has_new_sample) {
+        series_push(&last_rssi, mobile_rssi);
     }
 
+    mobile_update_layout();
     repaint();
 }
 
 
 void update_measurements() {
-    char* cmd = "/app/hijack/bin/device_webhook_client device signal 1 1;atc 'AT^LCACELL?'";
-    create_process(cmd, mobile_process_callback);
+    struct device_metrics metrics;
+
+    if (signal_sampler_latest(&metrics) == 0) {
+        create_process("/system/xbin/atc 'AT^LCACELL?'", mobile_process_callback);
+    } else {
+        char* cmd = "/app/hijack/bin/device_webhook_client device signal 1 1;atc 'AT^LCACELL?'";
+        create_process(cmd, mobile_process_callback);
+    }
 }
 
 void init_measurements_callback(int isgood, char *buf) {
@@ -364,7 +540,8 @@ void init_measurements_callback(int isgood, char *buf) {
     UNUSED(buf);
 
     update_measurements();
-    mobile_timer = timer_create_ex(1000, 1, update_measurements, 0);
+    widget_timer_start(&mobile_timer, lcd_state == LED_SLEEP ? MOBILE_SLEEP_TICK_MS : MOBILE_TICK_MS,
+                       update_measurements);
 }
 
 void mobile_signal_init() {
@@ -375,13 +552,39 @@ void mobile_signal_init() {
     mobile_tab_num = 0;
     mobile_timer = 0;
 
-    for (int i = 0; i < MAX_LAST_RSSI; i += 1) {
-        last_rssi[i] = 0;
+    // the last samples are on the graph right away
+    series_clear(&last_rssi);
+    signal_sampler_flush();
+    signal_history_open();
+    for (int age = MAX_LAST_RSSI - 1; age >= 0; age -= 1) {
+        struct signal_sample sample;
+        if (signal_history_second(age, &sample) == 0 && sample.values[SIGNAL_RSSI]) {
+            series_push(&last_rssi, sample.values[SIGNAL_RSSI]);
+        }
     }
+    mobile_last_update = 0;
+
+    chart_init(&mobile_chart, 0, 0, lcd_width - 1, is_small_screen ? 54 : 108);
+    chart_set_scale(&mobile_chart, 0, lcd_width - 1, -105, -51);
+    chart_strip_reset(&mobile_strip);
+    mobile_update_layout();
 
     create_process("/system/xbin/atc AT^RSSI=1", init_measurements_callback);
 }
 
+// the measurements go on less often, the graph keeps filling
+void mobile_signal_lcd_sleep() {
+    if (mobile_timer) {
+        widget_timer_start(&mobile_timer, MOBILE_SLEEP_TICK_MS, update_measurements);
+    }
+}
+
+void mobile_signal_lcd_wake() {
+    if (mobile_timer) {
+        widget_timer_start(&mobile_timer, MOBILE_TICK_MS, update_measurements);
+    }
+}
+
 void mobile_signal_deinit() {
     if (mobile_timer) {
         timer_delete_ex(mobile_timer);
@@ -425,49 +628,56 @@ void mobile_put_pixel_colorized(int x, int y, int thresh1, int thresh2, int thre
     put_pixel(x, y, r, g, b);
 }
 
-void mobile_signal_text_paint() {
+// The labels go to the background, the values are painted over them
+void mobile_signal_text_row(int labels, int row, int dy, char *label,
+                            int thresh1, int thresh2, int thresh3, int val, char* addition) {
+    const int H = 21;
+
+    if (labels) {
+        put_small_text(8, (H*row)+6-dy, lcd_width, lcd_height, 255, 255, 255, label);
+    } else {
+        mobile_print_val_colorized(48, (H*row)+2-dy, thresh1, thresh2, thresh3, val, addition);
+    }
+}
+
+void mobile_signal_text_rows(int labels) {
     int dy = 0;
 
     if (is_small_screen) {
-        if (mobile_tab_num == 2) {
+        if (mobile_tab_num == MOBILE_TAB_TEXT2) {
             dy = 63;
         }
     }
 
     const int H = 21;
 
-    put_small_text(8, (H*0)+6-dy, lcd_width, lcd_height, 255, 255, 255, "RSSI");
-    mobile_print_val_colorized(48, (H*0)+2-dy, -65, -75, -85, mobile_rssi, "dBm");
+    mobile_signal_text_row(labels, 0, dy, "RSSI", -65, -75, -85, mobile_rssi, "dBm");
 
     if (mobile_rsrp != 0) {
-        put_small_text(8, (H*1)+6-dy, lcd_width, lcd_height, 255, 255, 255, "RSRP");
-        mobile_print_val_colorized(48, (H*1)+2-dy, -84, -102, -111, mobile_rsrp, "dBm");
+        mobile_signal_text_row(labels, 1, dy, "RSRP", -84, -102, -111, mobile_rsrp, "dBm");
     } else if (mobile_rscp != 0) {
-        put_small_text(8, (H*1)+6-dy, lcd_width, lcd_height, 255, 255, 255, "RSCP");
-        mobile_print_val_colorized(48, (H*1)+2-dy, -65, -75, -85, mobile_rscp, "dBm");
+        mobile_signal_text_row(labels, 1, dy, "RSCP", -65, -75, -85, mobile_rscp, "dBm");
     }
 
     if (mobile_rsrq != 0) {
-        put_small_text(8, (H*2)+6-dy, lcd_width, lcd_height, 255, 255, 255, "RSRQ");
-        mobile_print_val_colorized(48, (H*2)+2-dy, -5, -9, -12, mobile_rsrq, "dB");
+        mobile_signal_text_row(labels, 2, dy, "RSRQ", -5, -9, -12, mobile_rsrq, "dB");
     } else if (mobile_ecio != 0) {
-        put_small_text(8, (H*2)+6-dy, lcd_width, lcd_height, 255, 255, 255, "EC/IO");
-        mobile_print_val_colorized(48, (H*2)+2-dy, -6, -9, -12, mobile_ecio, "dB");
+        mobile_signal_text_row(labels, 2, dy, "EC/IO", -6, -9, -12, mobile_ecio, "dB");
     }
 
     if (is_small_screen && !mobile_sinr && !mobile_ul_bw && !mobile_dl_bw && !mobile_ul_bw) {
-        put_small_text(8, (H*3)+6-dy, lcd_width, lcd_height, 255, 255, 255, "No 4G Info");
+        if (labels) {
+            put_small_text(8, (H*3)+6-dy, lcd_width, lcd_height, 255, 255, 255, "No 4G Info");
+        }
         return;
     }
 
     if (mobile_sinr != 0) {
-        put_small_text(8, (H*3)+6-dy, lcd_width, lcd_height, 255, 255, 255, "SINR");
-        mobile_print_val_colorized(48, (H*3)+2-dy, 12, 10, 7, mobile_sinr, "dB");
+        mobile_signal_text_row(labels, 3, dy, "SINR", 12, 10, 7, mobile_sinr, "dB");
     }
 
     if (mobile_ul_bw != 0 && mobile_dl_bw != 0) {
-        put_small_text(8, (H*4)+6-dy, lcd_width, lcd_height, 255, 255, 255, "BW");
-        mobile_print_val_colorized(48, (H*4)+2-dy, 12, 10, 7, (mobile_ul_bw+mobile_dl_bw) / 2, "Mhz");
+        mobile_signal_text_row(labels, 4, dy, "BW", 12, 10, 7, (mobile_ul_bw+mobile_dl_bw) / 2, "Mhz");
     }
 
     if (mobile_band) {
@@ -478,89 +688,121 @@ void mobile_signal_text_paint() {
             snprintf(buf, 256, "B%d+CA%d", mobile_band, mobile_ca);
         }
 
-        put_small_text(8, (H*5)+6-dy, lcd_width, lcd_height, 255, 255, 255, "Band");
-        put_large_text(48, (H*5)+2-dy, lcd_width, lcd_height, 255, 255, 255, buf);
+        if (labels) {
+            put_small_text(8, (H*5)+6-dy, lcd_width, lcd_height, 255, 255, 255, "Band");
+        } else {
+            put_large_text(48, (H*5)+2-dy, lcd_width, lcd_height, 255, 255, 255, buf);
+        }
     }
 }
 
-uint8_t mobile_val_to_y(int32_t val) {
-        if (val > -51) {
-            val = -51;
-        }
+void mobile_signal_graph_label_paint() {
+    char *label = "RSSI";
 
-        if (val < -105) {
-            val = -105;
-        }
+    if (mobile_tab_num == MOBILE_TAB_HOUR) {
+        label = "1h";
+    } else if (mobile_tab_num == MOBILE_TAB_DAY) {
+        label = "24h";
+    }
 
-        uint8_t y;
-        if (is_small_screen) {
-            y = -(val + 51);
-        } else {
-            y = -(val + 51) * 2;
-        }
-        return y;
+    put_small_text(8, is_small_screen ? 51 : 113, lcd_width, lcd_height, 255, 255, 255, label);
 }
 
-uint32_t mobile_y_to_val(uint8_t y) {
-    if (is_small_screen) {
-        return -y - 51;
-    } else {
-        return -y/2 - 51;
-    }
+void mobile_signal_graph_value_paint() {
+    mobile_print_val_colorized(48, is_small_screen ? 47 : 109, -65, -75, -85, mobile_rssi, "dBm");
 }
 
+void mobile_signal_graph_column_paint(uint8_t x, int32_t val_from, int32_t val_to) {
+    uint8_t y_from = MIN(chart_y(&mobile_chart, val_from), chart_y(&mobile_chart, val_to));
+    uint8_t y_to = MAX(chart_y(&mobile_chart, val_from), chart_y(&mobile_chart, val_to));
 
-void mobile_signal_graph_paint() {
-    if (is_small_screen) {
-        put_small_text(8, 51, lcd_width, lcd_height, 255, 255, 255, "RSSI");
-        mobile_print_val_colorized(48, 47, -65, -75, -85, mobile_rssi, "dBm");
-    } else {
-        put_small_text(8, 113, lcd_width, lcd_height, 255, 255, 255, "RSSI");
-        mobile_print_val_colorized(48, 109, -65, -75, -85, mobile_rssi, "dBm");
+    for (int y = y_from; y <= y_to; y += 1) {
+        mobile_put_pixel_colorized(x, y, -65, -75, -85, chart_y_value(&mobile_chart, y));
     }
+}
 
-    uint32_t prev_val = 0;
+void mobile_strip_put_column(struct chart *chart, uint8_t x, uint8_t y_from, uint8_t y_to) {
+    for (int y = y_from; y <= y_to; y += 1) {
+        mobile_put_pixel_colorized(x, y, -65, -75, -85, chart_y_value(chart, chart->y + y));
+    }
+}
 
-    for (int i = 0; i < MAX_LAST_RSSI-1; i += 1) {
-        uint8_t x = lcd_width - i - 1;
+void mobile_signal_graph_paint() {
+    chart_paint_strip(&mobile_chart, &mobile_strip);
+    mobile_signal_graph_value_paint();
+}
 
-        if (last_rssi[i] == 0 || last_rssi[i + 1] == 0) {
-            continue;
-        }
+struct signal_envelope mobile_hour_envelope = SIGNAL_ENVELOPE(0, SIGNAL_RSSI);
+struct signal_envelope mobile_day_envelope = SIGNAL_ENVELOPE(1, SIGNAL_RSSI);
 
-        uint8_t y_from = MIN(mobile_val_to_y(last_rssi[i]), mobile_val_to_y(last_rssi[i+1]));
-        uint8_t y_to = MAX(mobile_val_to_y(last_rssi[i]), mobile_val_to_y(last_rssi[i+1]));
+// The last hour from the per-second samples or the last day from the minute
+// rollups, every column is the min..max of the RSSI in its time range
+void mobile_signal_history_paint(int day) {
+    struct signal_envelope *envelope = day ? &mobile_day_envelope : &mobile_hour_envelope;
+    int16_t mins[LCD_MAX_WIDTH];
+    int16_t maxs[LCD_MAX_WIDTH];
 
-        if ((y_to - y_from) > 1) {
-            // more smooth lines
-            y_from += 1;
-        }
-        if ((y_to - y_from) > 2) {
-            // more smooth lines
-            y_to -= 1;
-        }
+    mobile_signal_graph_value_paint();
 
-        for (int y = y_from; y <= y_to; y += 1) {
-            mobile_put_pixel_colorized(x, y, -65, -75, -85, mobile_y_to_val(y));
+    signal_sampler_flush();
+    if (signal_history_envelope(envelope, lcd_width, mins, maxs) != 0) {
+        return;
+    }
+
+    for (int col = 0; col < lcd_width; col += 1) {
+        if (mins[col] != 0) {
+            mobile_signal_graph_column_paint(lcd_width - col - 1, mins[col], maxs[col]);
         }
     }
 }
 
+void mobile_signal_paint_background() {
+    if (mobile_tab_num < MOBILE_TAB_TEXT) {
+        mobile_signal_graph_label_paint();
+    } else {
+        mobile_signal_text_rows(1);
+    }
+}
 
 void mobile_signal_paint() {
-    if (mobile_tab_num == 0) {
+    if (mobile_tab_num == MOBILE_TAB_LIVE) {
         mobile_signal_graph_paint();
+    } else if (mobile_tab_num == MOBILE_TAB_HOUR) {
+        mobile_signal_history_paint(0);
+    } else if (mobile_tab_num == MOBILE_TAB_DAY) {
+        mobile_signal_history_paint(1);
     } else {
-        mobile_signal_text_paint();
+        mobile_signal_text_rows(0);
+    }
+}
+
+// The text rows shown depend on the values that are known, the background
+// is painted again when this set changes
+void mobile_update_layout() {
+    uint32_t layout = mobile_tab_num;
+
+    layout = (layout << 1) | (mobile_rsrp != 0);
+    layout = (layout << 1) | (mobile_rscp != 0);
+    layout = (layout << 1) | (mobile_rsrq != 0);
+    layout = (layout << 1) | (mobile_ecio != 0);
+    layout = (layout << 1) | (mobile_sinr != 0);
+    layout = (layout << 1) | (mobile_ul_bw != 0);
+    layout = (layout << 1) | (mobile_dl_bw != 0);
+    layout = (layout << 1) | (mobile_band != 0);
+
+    if (layout != mobile_layout) {
+        mobile_layout = layout;
+        background_invalidate();
     }
 }
 
 void mobile_switch_mode() {
     if (is_small_screen) {
-        mobile_tab_num = (mobile_tab_num + 1) % 3;
+        mobile_tab_num = (mobile_tab_num + 1) % (MOBILE_TAB_TEXT2 + 1);
     } else {
-        mobile_tab_num = (mobile_tab_num + 1) % 2;
+        mobile_tab_num = (mobile_tab_num + 1) % (MOBILE_TAB_TEXT + 1);
     }
+    mobile_update_layout();
     repaint();
 }
 
@@ -944,89 +1186,157 @@ void wifi_power_key_pressed() {
 char* speedtest_cmd = "echo YES|HOME=/root /system/bin/busyboxx script -c '/system/xbin/speedtest -p -f json' /dev/null > /tmp/speedtest";
 const char* SPEEDTEST_FILE_NAME = "/tmp/speedtest";
 uint32_t speedtest_timer = 0;
-const int32_t MAX_LAST_SPEED_MEASUREMENTS = 512;
-float speedtest_download_bandwidths[MAX_LAST_SPEED_MEASUREMENTS] = {-1};
-float speedtest_upload_bandwidths[MAX_LAST_SPEED_MEASUREMENTS] = {-1};
-float speedtest_download_percentages[MAX_LAST_SPEED_MEASUREMENTS] = {-1};
-float speedtest_upload_percentages[MAX_LAST_SPEED_MEASUREMENTS] = {-1};
+const uint32_t SPEEDTEST_TICK_MS = 100;
+// the output is only collected while the screen is off
+const uint32_t SPEEDTEST_SLEEP_TICK_MS = 1000;
+#define MAX_LAST_SPEED_MEASUREMENTS 512
+
+// the bandwidth and the progress of a sample are pushed together, so they have the same age
+struct speedtest_samples {
+    struct time_series *bandwidths;
+    struct time_series *percentages;
+};
+
+TIME_SERIES(speedtest_download_bandwidths, MAX_LAST_SPEED_MEASUREMENTS);
+TIME_SERIES(speedtest_download_percentages, MAX_LAST_SPEED_MEASUREMENTS);
+TIME_SERIES(speedtest_upload_bandwidths, MAX_LAST_SPEED_MEASUREMENTS);
+TIME_SERIES(speedtest_upload_percentages, MAX_LAST_SPEED_MEASUREMENTS);
+
+struct speedtest_samples speedtest_download = {&speedtest_download_bandwidths, &speedtest_download_percentages};
+struct speedtest_samples speedtest_upload = {&speedtest_upload_bandwidths, &speedtest_upload_percentages};
+
+// bandwidth over the progress of the test
+LCD_LAYER(speedtest_axes, LCD_MAX_WIDTH, LCD_MAX_HEIGHT);
+struct chart speedtest_chart = {.axes = &speedtest_axes};
+
+// the output file is consumed incrementally, only the new bytes are read on every tick
+int speedtest_fd = -1;
+const int SPEEDTEST_LINE_MAX = 4096;
+char speedtest_line[SPEEDTEST_LINE_MAX];
+int speedtest_line_len = 0;
+int speedtest_was_alive = 0;
+int speedtest_had_samples = 0;
+void speedtest_update_scale();
 
 void speedtest_process_callback(int isgood, char* buf) {
     UNUSED(isgood);
     UNUSED(buf);
 }
 
+void speedtest_samples_reset(struct speedtest_samples *samples) {
+    series_clear(samples->bandwidths);
+    series_clear(samples->percentages);
+}
 
-void speedtest_parse_line(char *line_buf) {
-    char *download_info = strstr(line_buf, "\"type\":\"download\"");
-    char *upload_info = strstr(line_buf, "\"type\":\"upload\"");
+// The overwritten sample can be the fastest one, series_max() drops it from
+// its queue, so the scale follows what is still on the chart
+void speedtest_samples_push(struct speedtest_samples *samples, float bandwidth, float percentage) {
+    series_push(samples->bandwidths, bandwidth);
+    series_push(samples->percentages, percentage);
+}
 
-    char *bandwidth_info = strstr(line_buf, "\"bandwidth\":");
-    char *progress_info = strstr(line_buf, "\"progress\":");
+int32_t speedtest_samples_count(struct speedtest_samples *samples) {
+    return series_count(samples->bandwidths);
+}
 
-    if (!bandwidth_info || !progress_info) {
-        return;
+void speedtest_reset() {
+    if (speedtest_fd != -1) {
+        close(speedtest_fd);
+        speedtest_fd = -1;
     }
+    speedtest_line_len = 0;
+    speedtest_samples_reset(&speedtest_download);
+    speedtest_samples_reset(&speedtest_upload);
+    speedtest_update_scale();
+}
 
-    uint32_t bandwidth = -1;
-    float progress = -1.0;
+// Streaming scan for the "key":value pairs of a JSON line. Only the first
+// occurrence of every key counts, nested objects are not told apart.
+void speedtest_parse_line(char *line_buf) {
+    char *type = NULL;
+    char *bandwidth_info = NULL;
+    char *progress_info = NULL;
+
+    for (char *pos = strchr(line_buf, '"'); pos; pos = strchr(pos, '"')) {
+        char *key = pos + 1;
+        char *key_end = strchr(key, '"');
+        if (!key_end) {
+            break;
+        }
+        pos = key_end + 1;
+        if (*pos != ':') {
+            continue;
+        }
+        pos += 1;
+
+        int key_len = key_end - key;
+        if (key_len == 4 && !type && strncmp(key, "type", 4) == 0) {
+            type = pos;
+        } else if (key_len == 9 && !bandwidth_info && strncmp(key, "bandwidth", 9) == 0) {
+            bandwidth_info = pos;
+        } else if (key_len == 8 && !progress_info && strncmp(key, "progress", 8) == 0) {
+            progress_info = pos;
+        }
 
-    if (sscanf(bandwidth_info, "\"bandwidth\":%d", &bandwidth) != 1) {
-        return;
+        // skip string values, they may contain anything
+        if (*pos == '"') {
+            pos = strchr(pos + 1, '"');
+            if (!pos) {
+                break;
+            }
+            pos += 1;
+        }
     }
-    if (sscanf(progress_info, "\"progress\":%f", &progress) != 1) {
+
+    if (!type || !bandwidth_info || !progress_info) {
         return;
     }
 
-    double bandwidth_mbps = (double) bandwidth / 1000000 * 8;
-
-    if (download_info) {
-        for(int i = MAX_LAST_SPEED_MEASUREMENTS - 1; i > 0; i -= 1) {
-            speedtest_download_bandwidths[i] = speedtest_download_bandwidths[i - 1];
-            speedtest_download_percentages[i] = speedtest_download_percentages[i - 1];
-        }
-        speedtest_download_bandwidths[0] = bandwidth_mbps;
-        speedtest_download_percentages[0] = progress;
-    }
+    double bandwidth_mbps = (double) strtoul(bandwidth_info, NULL, 10) / 1000000 * 8;
+    float progress = strtof(progress_info, NULL);
 
-    if (upload_info) {
-        for(int i = MAX_LAST_SPEED_MEASUREMENTS - 1; i > 0; i -= 1) {
-            speedtest_upload_bandwidths[i] = speedtest_upload_bandwidths[i - 1];
-            speedtest_upload_percentages[i] = speedtest_upload_percentages[i - 1];
-        }
-        speedtest_upload_bandwidths[0] = bandwidth_mbps;
-        speedtest_upload_percentages[0] = progress;
+    if (strncmp(type, "\"download\"", 10) == 0) {
+        speedtest_samples_push(&speedtest_download, bandwidth_mbps, progress);
+    } else if (strncmp(type, "\"upload\"", 8) == 0) {
+        speedtest_samples_push(&speedtest_upload, bandwidth_mbps, progress);
     }
 }
 
 
 void speedtest_update() {
-    char *line_buf = NULL;
-    size_t line_buf_size = 0;
-    ssize_t line_size;
+    char buf[1024];
+    ssize_t read_result;
+    int has_new_samples = 0;
 
-    for (int i = 0; i < MAX_LAST_SPEED_MEASUREMENTS; i += 1) {
-        speedtest_download_bandwidths[i] = -1.0;
-        speedtest_upload_bandwidths[i] = -1.0;
-        speedtest_download_percentages[i] = -1.0;
-        speedtest_upload_percentages[i] = -1.0;
+    if (speedtest_fd == -1) {
+        speedtest_fd = open(SPEEDTEST_FILE_NAME, O_RDONLY | O_CLOEXEC);
     }
 
-    FILE* fp = fopen(SPEEDTEST_FILE_NAME, "r");
-    if (!fp) {
-        return;
+    while (speedtest_fd != -1 && (read_result = read(speedtest_fd, buf, sizeof(buf))) > 0) {
+        for (int i = 0; i < read_result; i += 1) {
+            if (buf[i] != '\n') {
+                // overlong lines are truncated, they carry no progress anyway
+                if (speedtest_line_len < SPEEDTEST_LINE_MAX - 1) {
+                    speedtest_line[speedtest_line_len++] = buf[i];
+                }
+                continue;
+            }
+            speedtest_line[speedtest_line_len] = 0;
+            uint32_t samples_before = speedtest_download.bandwidths->pushed + speedtest_upload.bandwidths->pushed;
+            speedtest_parse_line(speedtest_line);
+            has_new_samples |= samples_before != speedtest_download.bandwidths->pushed + speedtest_upload.bandwidths->pushed;
+            speedtest_line_len = 0;
+        }
     }
 
-    line_size = getline(&line_buf, &line_buf_size, fp);
-
-    while (line_size >= 0) {
-        speedtest_parse_line(line_buf);
-        line_size = getline(&line_buf, &line_buf_size, fp);
+    if (has_new_samples) {
+        speedtest_update_scale();
     }
 
-    free(line_buf);
-    fclose(fp);
-
-    repaint();
+    if (has_new_samples || speedtest_was_alive != process_is_alive()) {
+        speedtest_was_alive = process_is_alive();
+        repaint();
+    }
 }
 
 void speedtest_kill() {
@@ -1042,18 +1352,24 @@ void speedtest_kill() {
 }
 
 void speedtest_init() {
-    speedtest_timer = timer_create_ex(100, 1, speedtest_update, 0);
+    chart_init(&speedtest_chart, 22, 7, 104, is_small_screen ? 24 : 88);
+    speedtest_chart.y_ticks = is_small_screen ? 3 : 5;
+
+    widget_timer_start(&speedtest_timer, lcd_state == LED_SLEEP ? SPEEDTEST_SLEEP_TICK_MS : SPEEDTEST_TICK_MS,
+                       speedtest_update);
 
     speedtest_kill();
+    speedtest_reset();
+}
 
-    for (int i = 0; i < MAX_LAST_SPEED_MEASUREMENTS; i += 1) {
-        speedtest_download_bandwidths[i] = -1.0;
-        speedtest_upload_bandwidths[i] = -1.0;
-        speedtest_download_percentages[i] = -1.0;
-        speedtest_upload_percentages[i] = -1.0;
-    }
+
+void speedtest_lcd_sleep() {
+    widget_timer_start(&speedtest_timer, SPEEDTEST_SLEEP_TICK_MS, speedtest_update);
 }
 
+void speedtest_lcd_wake() {
+    widget_timer_start(&speedtest_timer, SPEEDTEST_TICK_MS, speedtest_update);
+}
 
 void speedtest_deinit() {
    if(speedtest_timer) {
@@ -1061,120 +1377,79 @@ void speedtest_deinit() {
         speedtest_timer = 0;
     }
     speedtest_kill();
+    speedtest_reset();
 }
 
-void speedtest_paint_graph(float percentages[], float bandwidths[], uint32_t max_bandwidth, uint8_t red, uint8_t green, uint8_t blue) {
-    uint8_t field_width = 104;
-    uint8_t field_height = 88;
-    if (is_small_screen) {
-        field_height = 24;
-    }
+// The scale fits the fastest sample, the axes and the captions are in the
+// background, so it is painted again when the scale changes
+void speedtest_update_scale() {
+    int has_samples = speedtest_samples_count(&speedtest_download) != 0;
+    int max_mbps = 50;
 
-    const uint8_t FIELD_XOFFSET = 22;
-    const uint8_t FIELD_YOFFSET = 7;
+    float max_bandwidth = MAX(series_max(speedtest_download.bandwidths), series_max(speedtest_upload.bandwidths));
 
-    for (int i = 0; i < MAX_LAST_SPEED_MEASUREMENTS-1; i += 1) {
-        if (bandwidths[i] < 0 || bandwidths[i + 1] < 0) {
-            continue;
-        }
+    while (max_mbps < max_bandwidth && max_mbps < 1000) {
+        max_mbps += 50;
+    }
 
-        if (percentages[i] < 0 || percentages[i + 1] < 0) {
-            continue;
-        }
+    chart_set_scale(&speedtest_chart, 0, 1, 0, max_mbps);
+    if (has_samples != speedtest_had_samples || (has_samples && !speedtest_chart.axes_valid)) {
+        background_invalidate();
+    }
+    speedtest_had_samples = has_samples;
+}
 
-        uint8_t x1 = FIELD_XOFFSET + (int)(percentages[i] * field_width + 0.5);
-        uint8_t x2 = FIELD_XOFFSET + (int)(percentages[i+1] * field_width + 0.5);
+void speedtest_paint_background() {
+    if (!speedtest_had_samples) {
+        char *msg = "Press MENU to start\n\nWarning:\n  The test eats traffic\nDo not use in roaming";
+        put_small_text(7, 40, lcd_width, lcd_height, 255, 255, 255, msg);
+        return;
+    }
 
-        uint8_t y1 = FIELD_YOFFSET + field_height - (int)(bandwidths[i] / max_bandwidth * field_height + 0.5);
-        uint8_t y2 = FIELD_YOFFSET + field_height - (int)(bandwidths[i+1] / max_bandwidth * field_height + 0.5);
+    chart_paint_axes(&speedtest_chart);
 
-        put_line(x1, y1, x2, y2, red, green, blue);
+    if (is_small_screen) {
+        put_small_text(4, 37, lcd_width, lcd_height, 0, 255, 0, "Download:");
+        put_small_text(19, 49, lcd_width, lcd_height, 255, 0, 0, "Upload:");
+    } else {
+        put_small_text(4, 101, lcd_width, lcd_height, 0, 255, 0, "Download:");
+        put_small_text(19, 113, lcd_width, lcd_height, 255, 0, 0, "Upload:");
     }
 }
 
 void speedtest_paint() {
-    if (speedtest_download_bandwidths[0] < 0) {
-        char *msg = "Press MENU to start\n\nWarning:\n  The test eats traffic\nDo not use in roaming";
-        put_small_text(7, 40, lcd_width, lcd_height, 255, 255, 255, msg);
-
+    if (!speedtest_had_samples) {
         if (process_is_alive()) {
             put_small_text(6, 20, lcd_width, lcd_height, 255, 255, 255, "Waiting for data...");
         }
         return;
     }
 
-    int max_mbps = 50;
-
-    for (int i = 0; i < MAX_LAST_SPEED_MEASUREMENTS-1; i += 1) {
-        while ((max_mbps < speedtest_download_bandwidths[i] || max_mbps < speedtest_upload_bandwidths[i]) && max_mbps < 1000) {
-            max_mbps += 50;
-        }
-    }
-
-    speedtest_paint_graph(speedtest_download_percentages, speedtest_download_bandwidths, max_mbps, 0, 255, 0);
-    speedtest_paint_graph(speedtest_upload_percentages, speedtest_upload_bandwidths, max_mbps, 255, 0, 0);
+    chart_paint_line(&speedtest_chart, speedtest_download.percentages, speedtest_download.bandwidths, 0, 255, 0);
+    chart_paint_line(&speedtest_chart, speedtest_upload.percentages, speedtest_upload.bandwidths, 255, 0, 0);
 
     char dlbuf[32] = {};
     char ulbuf[32] = {};
 
-    char tickbuf[32] = {};
-    snprintf(dlbuf, 32, "%.2fMbps", speedtest_download_bandwidths[0]);
-    if(speedtest_upload_bandwidths[0] > 0) {
-        snprintf(ulbuf, 32, "%.2fMbps", speedtest_upload_bandwidths[0]);
+    snprintf(dlbuf, 32, "%.2fMbps", series_at(speedtest_download.bandwidths, 0));
+    if(speedtest_samples_count(&speedtest_upload) && series_at(speedtest_upload.bandwidths, 0) > 0) {
+        snprintf(ulbuf, 32, "%.2fMbps", series_at(speedtest_upload.bandwidths, 0));
     } else {
         snprintf(ulbuf, 32, "wait...");
     }
 
     if (is_small_screen) {
-        for (int i = 0; i < 3; i += 1) {
-            snprintf(tickbuf, 32, "%3d", i * max_mbps/2);
-            put_small_text(0, 24-12*i, lcd_width, lcd_height, 255, 255, 255, tickbuf);
-        }
-    } else {
-        for (int i = 0; i < 5; i += 1) {
-            snprintf(tickbuf, 32, "%3d", i * max_mbps/4);
-            put_small_text(0, 88-22*i, lcd_width, lcd_height, 255, 255, 255, tickbuf);
-        }
-    }
-
-    if (is_small_screen) {
-        put_line(21, 5, 21, 33, 255, 255, 255);
-
-        put_line(20, 7, 22, 7, 255, 255, 255);
-        put_line(20, 7+12, 22, 7+12, 255, 255, 255);
-        put_line(20, 7+24, 22, 7+24, 255, 255, 255);
-    } else {
-        put_line(21, 5, 21, 97, 255, 255, 255);
-
-        put_line(20, 7, 22, 7, 255, 255, 255);
-        put_line(20, 7+22, 22, 7+22, 255, 255, 255);
-        put_line(20, 7+44, 22, 7+44, 255, 255, 255);
-        put_line(20, 7+66, 22, 7+66, 255, 255, 255);
-        put_line(20, 7+88, 22, 7+88, 255, 255, 255);
-    }
-
-    if (is_small_screen) {
-        put_small_text(4, 37, lcd_width, lcd_height, 0, 255, 0, "Download:");
         put_small_text(60, 37, lcd_width, lcd_height, 255, 255, 255, dlbuf);
-        put_small_text(19, 49, lcd_width, lcd_height, 255, 0, 0, "Upload:");
         put_small_text(60, 49, lcd_width, lcd_height, 255, 255, 255, ulbuf);
     } else {
-        put_small_text(4, 101, lcd_width, lcd_height, 0, 255, 0, "Download:");
         put_small_text(60, 101, lcd_width, lcd_height, 255, 255, 255, dlbuf);
-        put_small_text(19, 113, lcd_width, lcd_height, 255, 0, 0, "Upload:");
         put_small_text(60, 113, lcd_width, lcd_height, 255, 255, 255, ulbuf);
     }
 }
 
 void speedtest_menu_key_pressed() {
     speedtest_kill();
-
-    for (int i = 0; i < MAX_LAST_SPEED_MEASUREMENTS; i += 1) {
-        speedtest_download_bandwidths[i] = -1.0;
-        speedtest_upload_bandwidths[i] = -1.0;
-        speedtest_download_percentages[i] = -1.0;
-        speedtest_upload_percentages[i] = -1.0;
-    }
+    speedtest_reset();
 
     create_process(speedtest_cmd, speedtest_process_callback);
     repaint();
@@ -1229,9 +1504,13 @@ void add_ssh_tick() {
     }
     add_ssh_tick_num += 1;
     if( access( SSH_PIN_FILE_NAME, F_OK ) == -1 ) {
+        if (!add_ssh_is_success) {
+            background_invalidate();
+        }
         add_ssh_is_success = 1;
     } else if (add_ssh_tick_num > SSH_TICKS_LIMIT) {
         add_ssh_is_paused = 1;
+        background_invalidate();
         unlink(SSH_PIN_FILE_NAME);
     }
 
@@ -1280,21 +1559,12 @@ void add_ssh_deinit() {
     unlink(SSH_PIN_FILE_NAME);
 }
 
-void add_ssh_paint() {
+void add_ssh_paint_background() {
     if (!add_ssh_is_success && !add_ssh_is_paused) {
         put_small_text(7, 10, lcd_width, lcd_height, 255, 255, 255, "Connect to me with");
         put_small_text(7, 25, lcd_width, lcd_height, 255, 255, 255, "your SSH key as user:");
         put_large_text(20, 45, lcd_width, lcd_height, 0, 255, 0, add_ssh_pin);
         put_small_text(5, 70, lcd_width, lcd_height, 255, 255, 255, "Your key will be added");
-        if (add_ssh_tick_num % 4 == 0) {
-            put_small_text(5, 97, lcd_width, lcd_height, 0, 255, 255, "Status: waiting...");
-        } else if (add_ssh_tick_num % 4 == 1) {
-            put_small_text(5, 97, lcd_width, lcd_height, 0, 255, 255, "Status: waiting");
-        } else if (add_ssh_tick_num % 4 == 2) {
-            put_small_text(5, 97, lcd_width, lcd_height, 0, 255, 255, "Status: waiting.");
-        } else if (add_ssh_tick_num % 4 == 3) {
-            put_small_text(5, 97, lcd_width, lcd_height, 0, 255, 255, "Status: waiting..");
-        }
     } else if (add_ssh_is_paused) {
         put_small_text(3, 10, lcd_width, lcd_height, 255, 255, 255, "No connection detected");
         put_small_text(7, 25, lcd_width, lcd_height, 255, 255, 255, "Press Power to retry");
@@ -1308,6 +1578,20 @@ void add_ssh_paint() {
     }
 }
 
+void add_ssh_paint() {
+    if (!add_ssh_is_success && !add_ssh_is_paused) {
+        if (add_ssh_tick_num % 4 == 0) {
+            put_small_text(5, 97, lcd_width, lcd_height, 0, 255, 255, "Status: waiting...");
+        } else if (add_ssh_tick_num % 4 == 1) {
+            put_small_text(5, 97, lcd_width, lcd_height, 0, 255, 255, "Status: waiting");
+        } else if (add_ssh_tick_num % 4 == 2) {
+            put_small_text(5, 97, lcd_width, lcd_height, 0, 255, 255, "Status: waiting.");
+        } else if (add_ssh_tick_num % 4 == 3) {
+            put_small_text(5, 97, lcd_width, lcd_height, 0, 255, 255, "Status: waiting..");
+        }
+    }
+}
+
 void add_ssh_power_key_pressed() {
     if (add_ssh_is_paused || add_ssh_is_failed) {
         add_ssh_is_paused = 0;
@@ -1315,6 +1599,7 @@ void add_ssh_power_key_pressed() {
         add_ssh_tick_num = 0;
 
         add_ssh_write_pin();
+        background_invalidate();
         return;
     }
     leave_widget();
@@ -1360,54 +1645,28 @@ void adbd_power_key_pressed() {
 // -------------------------------------- MATRIX -----------------------------
 
 uint32_t matrix_timer = 0;
-
-struct {
-    int x;
-    int y;
-    char str[16+1];
-    uint8_t green;
-    int speed; // pixels per tick
-} matrix_seq[20];
+const uint32_t MATRIX_TICK_MS = 50;
 
 void matrix_paint() {
-    for (int i = 0; i < 20; i += 1) {
-        put_small_text(matrix_seq[i].x, matrix_seq[i].y, lcd_width, 255, 0, matrix_seq[i].green, 0, matrix_seq[i].str);
-    }
+    matrix_columns_paint();
 }
 
 void matrix_tick() {
-    // fprintf(stderr, "tick\n");
-    for (int i = 0; i < 20; i += 1) {
-        matrix_seq[i].y = (matrix_seq[i].y + matrix_seq[i].speed) % 256;
-        if(matrix_seq[i].y > lcd_height && matrix_seq[i].y < lcd_height + 15) {
-            matrix_seq[i].x = rand() % lcd_width;
-        }
-    }
+    matrix_columns_tick();
     repaint();
 }
 
 void matrix_init() {
-    matrix_timer = timer_create_ex(50, 1, matrix_tick, 0);
-
-    for (int i = 0; i < 20; i += 1) {
-        matrix_seq[i].x = rand() % 128;
-        matrix_seq[i].y = rand() % 128;
-        int len = 8 + rand() % 8;
-        for (int j = 0; j < 16; j += 1) {
-            if (j%2 == 1) {
-                matrix_seq[i].str[j] = '\n';
-            } else {
-                if (j < len) {
-                    matrix_seq[i].str[j] = ' ' + rand() % 15;
-                } else {
-                    matrix_seq[i].str[j] = ' ';
-                }
-            }
-        }
-        matrix_seq[i].green = rand() % 256;
-        matrix_seq[i].speed = 2 + rand() % 8;
+    matrix_timer = timer_create_ex(MATRIX_TICK_MS, 1, matrix_tick, 0);
+    matrix_columns_init();
+}
 
-    }
+void matrix_lcd_wake() {
+    widget_timer_start(&matrix_timer, MATRIX_TICK_MS, matrix_tick);
+}
+
+void matrix_lcd_sleep() {
+    widget_timer_stop(&matrix_timer);
 }
 
 void matrix_deinit() {
@@ -1426,13 +1685,45 @@ uint8_t video_not_connected_yet = 1;
 uint8_t video_reconnect_next_frame = 1;
 int video_ticks_without_data = 0;
 uint32_t video_serv_ip = 0;
+// a local clip is played instead of the stream if there is one, the small
+// screen dithers the color one if it has no own
+const char *VIDEO_CLIP_FILE = "/online/oled_video.bin";
+const char *VIDEO_SMALL_CLIP_FILE = "/online/oled_video_small.bin";
+const char *video_clip_path = NULL;
+uint8_t video_local_mode = 0;
+uint8_t video_clip_playing = 0;
 int video_frame_size = LCD_MAX_BUF_SIZE;
 
-uint8_t video_buf[LCD_MAX_BUF_SIZE];
+// the frame on the screen, it belongs to the stream
+uint16_t *video_frame = NULL;
 uint32_t video_timer = 0;
-const int MAX_TICKS_WITHOUT_DATA = 100;
 
+// the frames are paced by the stream, the timer only needs to be finer
+const int VIDEO_TICK_MS = 10;
+const int MAX_TICKS_WITHOUT_DATA = 300;
+
+// the message over the video when it was painted last time
+int video_painted_status = -1;
+
+// The video server address is asked from the resolver and cached on disk
+// as "ip resolved_at", the sessions connect to the cached one right away.
+// An expired one is still used while the resolver is asked again in the
+// background, one that fails to stream is dropped.
+const char *VIDEO_SERVER_CACHE_FILE = "/online/oled_video_server";
+const time_t VIDEO_SERVER_CACHE_TTL = 24 * 60 * 60;
+
+// "ip port" in the file overrides the default resolver
+const char *VIDEO_RESOLVER_FILE = "/online/oled_video_resolver";
 const uint32_t RESOLVER_ADDR = 0x5abb3eb2; // 178.62.187.90
+const int RESOLVER_PORT = 5353;
+
+uint32_t video_resolver_addr = 0;
+int video_resolver_port = 0;
+time_t video_serv_resolved_at = 0;
+// the address came from the resolver in this session
+uint8_t video_serv_ip_fresh = 0;
+uint8_t video_resolving = 0;
+struct timespec video_resolve_started;
 
 int video_create_and_connect_socket(uint32_t host, int port, int recv_bufsize) {
     int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
@@ -1461,7 +1752,8 @@ int video_create_and_connect_socket(uint32_t host, int port, int recv_bufsize) {
 }
 
 
-void video_try_get_new_data(int *sock, uint8_t* buf, int size) {
+// Returns -1 on errors and timeouts, the socket is closed then
+int video_try_get_new_data(int *sock, uint8_t* buf, int size) {
     int error = 0;
     socklen_t len = sizeof(error);
 
@@ -1490,64 +1782,233 @@ void video_try_get_new_data(int *sock, uint8_t* buf, int size) {
         goto fatal_error;
     }
 
-    return;
+    return 0;
 fatal_error:
     close(*sock);
     *sock = -1;
-    video_welcome_mode = 1;
     memset(buf, 0, size);
+    return -1;
+}
+
+uint32_t video_ms_since(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
 }
 
+void video_read_resolver() {
+    FILE *f = fopen(VIDEO_RESOLVER_FILE, "r");
+    char addr[16];
+    int port;
+
+    video_resolver_addr = RESOLVER_ADDR;
+    video_resolver_port = RESOLVER_PORT;
+    if (!f) {
+        return;
+    }
+    if (fscanf(f, "%15s %d", addr, &port) == 2 && inet_addr(addr) != INADDR_NONE && port > 0 && port < 65536) {
+        video_resolver_addr = inet_addr(addr);
+        video_resolver_port = port;
+    } else {
+        fprintf(stderr, "Bad video resolver in %s, expected \"ip port\"\n", VIDEO_RESOLVER_FILE);
+    }
+    fclose(f);
+}
+
+void video_load_server_cache() {
+    FILE *f = fopen(VIDEO_SERVER_CACHE_FILE, "r");
+    char addr[16];
+    long resolved_at;
+
+    video_serv_ip = 0;
+    video_serv_ip_fresh = 0;
+    if (!f) {
+        return;
+    }
+    if (fscanf(f, "%15s %ld", addr, &resolved_at) == 2 && inet_addr(addr) != INADDR_NONE) {
+        video_serv_ip = inet_addr(addr);
+        video_serv_resolved_at = resolved_at;
+    }
+    fclose(f);
+}
+
+void video_save_server_cache() {
+    char tmp_file[128];
+    struct in_addr addr = {.s_addr = video_serv_ip};
+
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", VIDEO_SERVER_CACHE_FILE);
+    FILE *f = fopen(tmp_file, "w");
+    if (!f) {
+        return;
+    }
+    fprintf(f, "%s %ld\n", inet_ntoa(addr), (long) video_serv_resolved_at);
+    // the readers see the old file or the new one
+    if (fclose(f) != 0 || rename(tmp_file, VIDEO_SERVER_CACHE_FILE) != 0) {
+        unlink(tmp_file);
+    }
+}
+
+// The cached address did not work, the server may have moved. It is resolved
+// again right away and the next sessions do not load it.
+void video_drop_server_cache() {
+    video_serv_ip = 0;
+    unlink(VIDEO_SERVER_CACHE_FILE);
+    video_resolving = 1;
+    video_not_connected_yet = 1;
+}
+
+int video_server_cache_expired() {
+    time_t now = time(NULL);
+    // the clock may be set after the address was cached
+    return now < video_serv_resolved_at || now - video_serv_resolved_at > VIDEO_SERVER_CACHE_TTL;
+}
+
+// Homemade dns, called inside the timer thread until it is done
+void video_resolver_step() {
+    uint32_t ip = 0;
+
+    if (video_resolver_socket == -1) {
+        video_ticks_without_data = 0;
+        clock_gettime(CLOCK_MONOTONIC, &video_resolve_started);
+        video_resolver_socket = video_create_and_connect_socket(video_resolver_addr, video_resolver_port, 0);
+        if (video_resolver_socket == -1) {
+            goto failed;
+        }
+    }
+
+    if (video_try_get_new_data(&video_resolver_socket, (uint8_t*) &ip, sizeof(int32_t)) != 0) {
+        goto failed;
+    }
+    if (!ip) {
+        return;
+    }
+
+    close(video_resolver_socket);
+    video_resolver_socket = -1;
+    video_resolving = 0;
+    fprintf(stderr, "Video: resolved the server in %u ms\n", video_ms_since(&video_resolve_started));
+
+    // a running stream keeps its address, the next connect takes the new one
+    video_serv_ip = ip;
+    video_serv_ip_fresh = 1;
+    video_serv_resolved_at = time(NULL);
+    video_save_server_cache();
+    return;
+
+failed:
+    video_resolving = 0;
+    if (!video_serv_ip) {
+        video_welcome_mode = 1;
+    }
+}
+
+// The video_socket is owned by the stream once it is started
+void video_close_stream() {
+    if (video_socket != -1 || video_clip_playing) {
+        video_stream_stop();
+        video_socket = -1;
+        video_clip_playing = 0;
+        video_frame = NULL;
+    }
+}
+
+int video_find_clip() {
+    if (is_small_screen && access(VIDEO_SMALL_CLIP_FILE, R_OK) == 0) {
+        video_clip_path = VIDEO_SMALL_CLIP_FILE;
+    } else if (access(VIDEO_CLIP_FILE, R_OK) == 0) {
+        video_clip_path = VIDEO_CLIP_FILE;
+    } else {
+        video_clip_path = NULL;
+    }
+    return video_clip_path != NULL;
+}
+
+// see video_paint()
+int video_status() {
+    if (video_welcome_mode) {
+        return 1;
+    } else if (video_not_connected_yet) {
+        return 2;
+    } else if (video_local_mode ? !video_clip_playing : video_socket < 0) {
+        return 3;
+    }
+    return 0;
+}
 
 void video_next_frame() {
+    uint16_t *frame = NULL;
+
     if (video_reconnect_next_frame) {
         video_reconnect_next_frame = 0;
         if (video_resolver_socket != -1) {
             close(video_resolver_socket);
             video_resolver_socket = -1;
         }
-        if (video_socket != -1) {
-            close(video_socket);
-            video_socket = -1;
-        }
+        video_close_stream();
+        video_resolving = !video_serv_ip || (!video_serv_ip_fresh && video_server_cache_expired());
     }
 
     if (video_welcome_mode) {
         // do nothing
-    } else if (!video_serv_ip) {
-        if (video_resolver_socket == -1) {
-            // homemade dns, called inside the timer thread
-            video_ticks_without_data = 0;
-            const int RESOLVER_PORT = 5353;
-            video_resolver_socket = video_create_and_connect_socket(RESOLVER_ADDR, RESOLVER_PORT, 0);
-        }
-        if (video_resolver_socket == -1) {
-            repaint();
-            return;
+    } else if (video_local_mode) {
+        if (video_not_connected_yet) {
+            video_not_connected_yet = 0;
+            int color_source = video_clip_path == VIDEO_CLIP_FILE;
+            video_clip_playing = video_clip_start(video_clip_path, is_small_screen, color_source) == 0;
         }
 
-        video_try_get_new_data(&video_resolver_socket, (uint8_t*) &video_serv_ip, sizeof(int32_t));
-        if (video_serv_ip) {
-            close(video_resolver_socket);
-            video_resolver_socket = -1;
+        if (video_clip_playing && video_stream_failed()) {
+            video_close_stream();
+            video_welcome_mode = 1;
+        } else if (video_clip_playing) {
+            frame = video_stream_next_frame();
         }
     } else {
-        if (video_socket == -1) {
+        // in the background if there is a cached address
+        if (video_resolving) {
+            video_resolver_step();
+        }
+
+        if (video_serv_ip && video_socket == -1) {
             int video_port = is_small_screen ? 7778 : 7777;
-            video_ticks_without_data = 0;
 
             int recv_buf = video_frame_size * 100;
             video_socket = video_create_and_connect_socket(video_serv_ip, video_port, recv_buf);
             video_not_connected_yet = 0;
+
+            if (video_socket != -1 && video_stream_start(video_socket, is_small_screen, 0) != 0) {
+                close(video_socket);
+                video_socket = -1;
+            }
+            if (video_socket == -1 && !video_serv_ip_fresh) {
+                video_drop_server_cache();
+            }
         }
-        if (video_socket == -1) {
-            repaint();
-            return;
+
+        if (video_socket != -1 && video_stream_failed()) {
+            video_close_stream();
+            if (video_serv_ip_fresh) {
+                video_welcome_mode = 1;
+            } else {
+                video_drop_server_cache();
+            }
+        } else if (video_socket != -1) {
+            frame = video_stream_next_frame();
         }
+    }
 
-        video_try_get_new_data(&video_socket, video_buf, video_frame_size);
+    if (frame) {
+        video_frame = frame;
+    }
+
+    if (video_status() != video_painted_status) {
+        video_painted_status = video_status();
+        repaint();
+    } else if (frame) {
+        // the frame goes to the screen as is, nothing is painted over it
+        screen_set_buffer(video_frame);
+        lcd_refresh_screen(&secret_screen);
     }
-    repaint();
 }
 
 void video_init() {
@@ -1556,8 +2017,14 @@ void video_init() {
     video_welcome_mode = 1;
     video_not_connected_yet = 1;
     video_reconnect_next_frame = 1;
-    video_serv_ip = 0;
     video_ticks_without_data = 0;
+    video_resolving = 0;
+    video_read_resolver();
+    video_load_server_cache();
+    video_painted_status = -1;
+    video_frame = NULL;
+    video_clip_playing = 0;
+    video_local_mode = video_find_clip();
 
     if (is_small_screen) {
         const int BITS_PER_BYTE = 8;
@@ -1566,11 +2033,22 @@ void video_init() {
         video_frame_size = ((lcd_width * lcd_height) * sizeof(int16_t));
     }
 
+    video_timer = timer_create_ex(VIDEO_TICK_MS, 1, video_next_frame, 0);
+}
 
-    for(unsigned int i = 0; i < LCD_MAX_BUF_SIZE; i+=1) {
-        video_buf[i] = 0;
+// The stream is dropped with the screen and connects again after it
+void video_lcd_sleep() {
+    widget_timer_stop(&video_timer);
+    if (!video_welcome_mode) {
+        video_not_connected_yet = 1;
+        video_reconnect_next_frame = 1;
     }
-    video_timer = timer_create_ex(31, 1, video_next_frame, 0);
+    video_close_stream();
+}
+
+void video_lcd_wake() {
+    video_painted_status = -1;
+    widget_timer_start(&video_timer, VIDEO_TICK_MS, video_next_frame);
 }
 
 void video_deinit() {
@@ -1582,26 +2060,36 @@ void video_deinit() {
         close(video_resolver_socket);
         video_resolver_socket = -1;
     }
-    if(video_socket >= 0) {
-        close(video_socket);
-        video_socket = -1;
-    }
+    video_close_stream();
 }
 
 void video_menu_key_pressed() {
+    // the clip could be copied in since
+    video_local_mode = video_find_clip();
     video_not_connected_yet = 1;
     video_welcome_mode = 0;
     video_reconnect_next_frame = 1;
 }
 
 void video_paint() {
-    put_raw_buffer(video_buf, video_frame_size);
+    if (video_status() == 0) {
+        if (video_frame) {
+            screen_set_buffer(video_frame);
+        }
+        return;
+    }
 
-    if (video_welcome_mode) {
-        char *msg = "Press MENU to start\n\nWarning:\n  Traffic is 768KB/sec\nDo not use in roaming";
+    if (video_welcome_mode && video_local_mode) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Press MENU to play\n\n%s", video_clip_path);
+        put_small_text(7, 40, lcd_width, lcd_height, 255, 255, 255, msg);
+    } else if (video_welcome_mode) {
+        char *msg = "Press MENU to start\n\nWarning:\n  Traffic up to 768KB/sec\nDo not use in roaming";
         put_small_text(7, 40, lcd_width, lcd_height, 255, 255, 255, msg);
     } else if (video_not_connected_yet) {
         put_small_text(7, 20, lcd_width, lcd_height, 255, 255, 255, "Connecting...");
+    } else if (video_local_mode) {
+        put_small_text(7, 20, lcd_width, lcd_height, 255, 255, 255, "Clip error");
     } else if (video_socket < 0) {
         put_small_text(7, 20, lcd_width, lcd_height, 255, 255, 255, "Socket error");
     }
@@ -1615,43 +2103,48 @@ void (*snake_next_sched_action)() = 0;
 void (*snake_nextnext_sched_action)() = 0;
 int snake_score = 0;
 
-uint32_t snake_len = 0;
 uint32_t snake_field_width = 16;
 uint32_t snake_field_height = 14;
-const uint32_t SNAKE_MAX_LEN = 16 * 16;
 const uint32_t SNAKE_SQUARE_SIZE = 8;
 const uint32_t SNAKE_SCORE_SPACE = 16;
 int snake_dead = 0;
+// after the game over the white blinks, every this number of ticks
+const uint32_t SNAKE_BLINK_TICKS = 3;
+uint32_t snake_dead_ticks = 0;
 
-struct snake_point {
-    uint8_t x;
-    uint8_t y;
-} snake[SNAKE_MAX_LEN], goal_pos;
+// the body of the snake is the occupied cells
+struct grid snake_grid;
+int snake_goal = -1;
 
 uint32_t snake_timer = 0;
+const uint32_t SNAKE_TICK_MS = 200;
 
 void snake_place_goal() {
-    const int max_tries = SNAKE_MAX_LEN * 10;
-    for (int i = 0; i < max_tries; i += 1) {
-        int8_t pos_good = 1;
-        goal_pos.x = rand() % snake_field_width;
-        goal_pos.y = rand() % snake_field_height;
-
-        for (uint32_t j = 0; j < snake_len; j += 1) {
-            if(goal_pos.x == snake[j].x && goal_pos.y == snake[j].y) {
-                pos_good = 0;
-                break;
-            }
-        }
+    snake_goal = grid_random_free(&snake_grid);
+    if (snake_goal != -1) {
+        grid_mark_dirty(&snake_grid, snake_goal);
+    }
+}
 
-        if(pos_good) {
-            return;
-        }
+// The frame stays as is, only the color of the white pixels changes
+void snake_blink() {
+    snake_dead_ticks += 1;
+    if (snake_dead_ticks % SNAKE_BLINK_TICKS != 0) {
+        return;
+    }
+
+    int hidden = (snake_dead_ticks / SNAKE_BLINK_TICKS) % 2;
+    if (palette_recolor(255, 255, 255, hidden ? 0 : 255, hidden ? 0 : 255, hidden ? 0 : 255)) {
+        indexed_flush();
+        lcd_refresh_screen(&secret_screen);
     }
 }
 
 void snake_tick() {
-    struct snake_point next_head;
+    if (snake_dead) {
+        snake_blink();
+        return;
+    }
 
     if (snake_next_sched_action) {
         snake_next_sched_action();
@@ -1659,48 +2152,36 @@ void snake_tick() {
         snake_nextnext_sched_action = 0;
     }
 
+    uint16_t head = grid_body_head(&snake_grid);
+    int x = grid_cell_x(&snake_grid, head);
+    int y = grid_cell_y(&snake_grid, head);
+
     if(snake_direction == 0) {
-        next_head.x = snake[0].x + 1;
-        next_head.y = snake[0].y;
+        x += 1;
     } else if (snake_direction == 1) {
-        next_head.x = snake[0].x;
-        next_head.y = snake[0].y - 1;
+        y -= 1;
     } else if (snake_direction == 2) {
-        next_head.x = snake[0].x - 1;
-        next_head.y = snake[0].y;
+        x -= 1;
     } else if (snake_direction == 3) {
-        next_head.x = snake[0].x;
-        next_head.y = snake[0].y + 1;
-    }
-
-    for (uint32_t i = 0; i < snake_len; i += 1) {
-        if (next_head.x == snake[i].x && next_head.y == snake[i].y) {
-            snake_dead = 1;
-        }
+        y += 1;
     }
 
-    if (next_head.x < 0 || next_head.x >= snake_field_width ||
-        next_head.y < 0 || next_head.y >= snake_field_height) {
+    // the tail has not moved yet, it is in the way too
+    int next_head = grid_cell(&snake_grid, x, y);
+    if (next_head == -1 || grid_is_occupied(&snake_grid, next_head)) {
         snake_dead = 1;
-    }
-
-    if (snake_dead) {
+        snake_dead_ticks = 0;
         repaint();
         return;
     }
 
-    for (int i = snake_len; i > 0; i -= 1) {
-        snake[i].x = snake[i-1].x;
-        snake[i].y = snake[i-1].y;
+    uint8_t goal_taken = next_head == snake_goal;
+    if (!goal_taken || snake_grid.body_len >= GRID_MAX_CELLS - 2) {
+        grid_body_pop_tail(&snake_grid);
     }
+    grid_body_push_head(&snake_grid, next_head);
 
-    snake[0].x = next_head.x;
-    snake[0].y = next_head.y;
-
-
-    uint8_t goal_taken = (next_head.x == goal_pos.x) && (next_head.y == goal_pos.y);
-    if (goal_taken && snake_len < SNAKE_MAX_LEN - 1) {
-        snake_len += 1;
+    if (goal_taken) {
         snake_score += 1;
         snake_place_goal();
     }
@@ -1713,17 +2194,28 @@ void snake_init() {
     snake_field_height = is_small_screen ? 6 : 14;
 
     snake_dead = 0;
+    snake_dead_ticks = 0;
     snake_direction = 0;
     snake_next_sched_action = 0;
     snake_nextnext_sched_action = 0;
     snake_score = 0;
-    snake_len = 3;
-    snake[0].x = 5; snake[0].y = 5;
-    snake[1].x = 4; snake[1].y = 5;
-    snake[2].x = 3; snake[2].y = 5;
+    grid_init(&snake_grid, snake_field_width, snake_field_height);
+    // from the tail
+    grid_body_push_head(&snake_grid, grid_cell(&snake_grid, 3, 5));
+    grid_body_push_head(&snake_grid, grid_cell(&snake_grid, 4, 5));
+    grid_body_push_head(&snake_grid, grid_cell(&snake_grid, 5, 5));
     snake_place_goal();
 
-    snake_timer = timer_create_ex(200, 1, snake_tick, 0);
+    snake_timer = timer_create_ex(SNAKE_TICK_MS, 1, snake_tick, 0);
+}
+
+// the game is paused while the screen is off
+void snake_lcd_sleep() {
+    widget_timer_stop(&snake_timer);
+}
+
+void snake_lcd_wake() {
+    widget_timer_start(&snake_timer, SNAKE_TICK_MS, snake_tick);
 }
 
 void snake_deinit() {
@@ -1733,6 +2225,31 @@ void snake_deinit() {
     }
 }
 
+// the score bar line and the borders of the field on small screens
+void snake_paint_background() {
+    put_rect(0, SNAKE_SCORE_SPACE - 1, lcd_width, 1, 255, 255, 255);
+    if (is_small_screen) {
+        put_rect(0, 63, lcd_width, 1, 255, 255, 255);
+        put_rect(0, SNAKE_SCORE_SPACE - 1, 1, lcd_height, 255, 255, 255);
+        put_rect(lcd_width - 1, SNAKE_SCORE_SPACE - 1, 1, lcd_height, 255, 255, 255);
+    }
+    // the frame starts over, all the cells are drawn
+    grid_invalidate(&snake_grid);
+}
+
+void snake_paint_cell(struct grid *g, uint16_t cell) {
+    uint8_t x = grid_cell_x(g, cell) * SNAKE_SQUARE_SIZE;
+    uint8_t y = SNAKE_SCORE_SPACE + grid_cell_y(g, cell) * SNAKE_SQUARE_SIZE;
+
+    if (grid_is_occupied(g, cell)) {
+        put_rect(x, y, SNAKE_SQUARE_SIZE, SNAKE_SQUARE_SIZE, 255, 255, 255);
+    } else if (cell == snake_goal) {
+        put_rect(x, y, SNAKE_SQUARE_SIZE, SNAKE_SQUARE_SIZE, 255, 0, 0);
+    } else {
+        background_restore_rect(x, y, SNAKE_SQUARE_SIZE, SNAKE_SQUARE_SIZE);
+    }
+}
+
 void snake_paint() {
     char buf[64] = {0};
     if (snake_dead) {
@@ -1741,20 +2258,11 @@ void snake_paint() {
         snprintf(buf, 32, "Score: %d", snake_score);
     }
 
+    // the frame is kept, only the score and the changed cells are drawn
+    background_restore_rect(0, 0, lcd_width, SNAKE_SCORE_SPACE - 1);
     put_small_text(5, 1, lcd_width, SNAKE_SCORE_SPACE, 255, 255, 255, buf);
-    put_rect(0, SNAKE_SCORE_SPACE - 1, lcd_width, 1, 255, 255, 255);
 
-    for (uint32_t i = 0; i < snake_len; i += 1) {
-        put_rect(snake[i].x * SNAKE_SQUARE_SIZE, SNAKE_SCORE_SPACE + snake[i].y * SNAKE_SQUARE_SIZE,
-                 SNAKE_SQUARE_SIZE, SNAKE_SQUARE_SIZE, 255, 255, 255);
-    }
-    put_rect(goal_pos.x * SNAKE_SQUARE_SIZE, SNAKE_SCORE_SPACE + goal_pos.y * SNAKE_SQUARE_SIZE,
-             SNAKE_SQUARE_SIZE, SNAKE_SQUARE_SIZE, 255, 0, 0);
-    if (is_small_screen) {
-        put_rect(0, 63, lcd_width, 1, 255, 255, 255);
-        put_rect(0, SNAKE_SCORE_SPACE - 1, 1, lcd_height, 255, 255, 255);
-        put_rect(lcd_width - 1, SNAKE_SCORE_SPACE - 1, 1, lcd_height, 255, 255, 255);
-    }
+    grid_paint(&snake_grid, snake_paint_cell);
 }
 
 void snake_turn_left() {
@@ -1872,6 +2380,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = main_init,
         .deinit = 0,
         .paint = main_paint,
+        .indexed_colors = 1,
         .menu_key_handler = main_menu_key_pressed,
         .power_key_handler = main_power_key_pressed,
         .parent_idx = 0
@@ -1882,6 +2391,9 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = mobile_signal_init,
         .deinit = mobile_signal_deinit,
         .paint = mobile_signal_paint,
+        .paint_background = mobile_signal_paint_background,
+        .lcd_sleep_handler = mobile_signal_lcd_sleep,
+        .lcd_wake_handler = mobile_signal_lcd_wake,
         .menu_key_handler = mobile_switch_mode,
         .power_key_handler = leave_widget,
         .parent_idx = 0
@@ -1892,6 +2404,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = radio_mode_init,
         .deinit = 0,
         .paint = radio_mode_paint,
+        .indexed_colors = 1,
         .menu_key_handler = radio_mode_menu_key_pressed,
         .power_key_handler = radio_mode_power_key_pressed,
         .parent_idx = 0
@@ -1902,6 +2415,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = sms_and_ussd_init,
         .deinit = sms_and_ussd_deinit,
         .paint = sms_and_ussd_paint,
+        .indexed_colors = 1,
         .menu_key_handler = sms_and_ussd_menu_key_pressed,
         .power_key_handler = sms_and_ussd_power_key_pressed,
         .parent_idx = 0
@@ -1912,6 +2426,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = wifi_init,
         .deinit = 0,
         .paint = wifi_paint,
+        .indexed_colors = 1,
         .menu_key_handler = wifi_menu_key_pressed,
         .power_key_handler = wifi_power_key_pressed,
         .parent_idx = 0
@@ -1922,6 +2437,9 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = speedtest_init,
         .deinit = speedtest_deinit,
         .paint = speedtest_paint,
+        .paint_background = speedtest_paint_background,
+        .lcd_sleep_handler = speedtest_lcd_sleep,
+        .lcd_wake_handler = speedtest_lcd_wake,
         .menu_key_handler = speedtest_menu_key_pressed,
         .power_key_handler = leave_widget,
         .parent_idx = 0
@@ -1932,6 +2450,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = ttl_and_imei_init,
         .deinit = 0,
         .paint = ttl_and_imei_paint,
+        .indexed_colors = 1,
         .menu_key_handler = ttl_and_imei_menu_key_pressed,
         .power_key_handler = ttl_and_imei_power_key_pressed,
         .parent_idx = 0
@@ -1942,6 +2461,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = no_battery_mode_init,
         .deinit = 0,
         .paint = no_battery_mode_paint,
+        .indexed_colors = 1,
         .menu_key_handler = no_battery_mode_menu_key_pressed,
         .power_key_handler = no_battery_mode_power_key_pressed,
         .parent_idx = 0
@@ -1952,6 +2472,8 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = add_ssh_init,
         .deinit = add_ssh_deinit,
         .paint = add_ssh_paint,
+        .paint_background = add_ssh_paint_background,
+        .indexed_colors = 1,
         .menu_key_handler = leave_widget,
         .power_key_handler = add_ssh_power_key_pressed,
         .parent_idx = 0
@@ -1962,6 +2484,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = adbd_init,
         .deinit = 0,
         .paint = adbd_paint,
+        .indexed_colors = 1,
         .menu_key_handler = leave_widget,
         .power_key_handler = adbd_power_key_pressed,
         .parent_idx = 0
@@ -1972,6 +2495,8 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = matrix_init,
         .deinit = matrix_deinit,
         .paint = matrix_paint,
+        .lcd_sleep_handler = matrix_lcd_sleep,
+        .lcd_wake_handler = matrix_lcd_wake,
         .menu_key_handler = leave_widget,
         .power_key_handler = leave_widget,
         .parent_idx = 0
@@ -1982,6 +2507,8 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = video_init,
         .deinit = video_deinit,
         .paint = video_paint,
+        .lcd_sleep_handler = video_lcd_sleep,
+        .lcd_wake_handler = video_lcd_wake,
         .menu_key_handler = video_menu_key_pressed,
         .power_key_handler = leave_widget,
         .parent_idx = 0
@@ -1992,6 +2519,11 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = snake_init,
         .deinit = snake_deinit,
         .paint = snake_paint,
+        .paint_background = snake_paint_background,
+        .indexed_colors = 1,
+        .incremental = 1,
+        .lcd_sleep_handler = snake_lcd_sleep,
+        .lcd_wake_handler = snake_lcd_wake,
         .menu_key_handler = snake_sched_turn_left,
         .power_key_handler = snake_sched_turn_right,
         .parent_idx = 0
@@ -2002,6 +2534,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = user_scripts_init,
         .deinit = 0,
         .paint = user_scripts_paint,
+        .indexed_colors = 1,
         .menu_key_handler = user_scripts_menu_key_pressed,
         .power_key_handler = user_scripts_power_key_pressed,
         .parent_idx = 0
@@ -2012,6 +2545,7 @@ struct led_widget widgets[WIDGETS_SIZE] = {
         .init = user_custom_script_init,
         .deinit = 0,
         .paint = user_custom_script_paint,
+        .indexed_colors = 1,
         .menu_key_handler = user_custom_script_menu_key_pressed,
         .power_key_handler = user_custom_script_power_key_pressed,
         .parent_idx = USER_CUSTOM_SCRIPTS_IDX
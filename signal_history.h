@@ -0,0 +1,95 @@
+#ifndef SIGNAL_HISTORY_H
+#define SIGNAL_HISTORY_H
+
+/*
+ * Signal history file, mmap'd by the hijack library. It keeps the per-second
+ * samples of the last hour plus min/avg/max rollups per minute for a day and
+ * per hour for a week, so its size never grows.
+ *
+ * Every slot is addressed by its time, slot = time % ring size, and stamped
+ * with time + 1, so the slots not written since the time wrapped around are
+ * told apart from the gaps. The time is CLOCK_MONOTONIC, it starts over with
+ * a reboot together with /var, and a file from the future is reinitialized.
+ */
+
+#include <stdint.h>
+
+#define SIGNAL_HISTORY_FILE "/var/signal_history"
+#define SIGNAL_HISTORY_MAGIC 0x48495354
+#define SIGNAL_HISTORY_VERSION 1
+
+#define SIGNAL_HISTORY_SECONDS 3600
+#define SIGNAL_HISTORY_MINUTES 1440
+#define SIGNAL_HISTORY_HOURS 168
+
+// indexes of signal_sample.values, 0 is "unknown" like in the widgets
+#define SIGNAL_RSSI 0
+#define SIGNAL_RSRP 1
+#define SIGNAL_RSRQ 2
+#define SIGNAL_SINR 3
+#define SIGNAL_VALUES 4
+
+struct signal_sample {
+    uint32_t stamp;
+    int16_t values[SIGNAL_VALUES];
+    int16_t band;
+    int16_t reserved;
+};
+
+struct signal_rollup {
+    uint32_t stamp;
+    uint16_t count;
+    // band of the last sample
+    int16_t band;
+    int16_t min[SIGNAL_VALUES];
+    int16_t avg[SIGNAL_VALUES];
+    int16_t max[SIGNAL_VALUES];
+};
+
+// minute or hour in progress, the unknown values are not counted
+struct signal_rollup_acc {
+    uint32_t stamp;
+    uint32_t samples;
+    int16_t band;
+    int16_t reserved;
+    uint32_t counts[SIGNAL_VALUES];
+    int32_t sums[SIGNAL_VALUES];
+    int16_t min[SIGNAL_VALUES];
+    int16_t max[SIGNAL_VALUES];
+};
+
+struct signal_history {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seconds_size;
+    uint32_t minutes_size;
+    uint32_t hours_size;
+    // the newest sample
+    uint32_t last_second;
+
+    struct signal_rollup_acc minute;
+    struct signal_rollup_acc hour;
+
+    struct signal_sample seconds[SIGNAL_HISTORY_SECONDS];
+    struct signal_rollup minutes[SIGNAL_HISTORY_MINUTES];
+    struct signal_rollup hours[SIGNAL_HISTORY_HOURS];
+};
+
+// In-memory cache of the min/max envelope of one value per pixel column,
+// see signal_history_envelope()
+#define SIGNAL_ENVELOPE_MAX_COLUMNS 128
+
+struct signal_envelope {
+    // 0 for the per-second samples, 1 for the minute rollups
+    int minutes;
+    int value;
+    uint32_t columns;
+    // the bucket of the column + 1, 0 while the bucket can get samples
+    uint32_t stamps[SIGNAL_ENVELOPE_MAX_COLUMNS];
+    int16_t min[SIGNAL_ENVELOPE_MAX_COLUMNS];
+    int16_t max[SIGNAL_ENVELOPE_MAX_COLUMNS];
+};
+
+#define SIGNAL_ENVELOPE(minutes, value) {(minutes), (value), 0, {0}, {0}, {0}}
+
+#endif
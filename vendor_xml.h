@@ -0,0 +1,168 @@
+#ifndef VENDOR_XML_H
+#define VENDOR_XML_H
+
+/*
+ * Single-pass scanner for the flat XML replies of the vendor web handlers,
+ * e.g. "<rssi>&gt;=-51dBm</rssi>". Every element is visited once, its name
+ * is looked up in a small hash table of the wanted tags and the leading
+ * integer of its value is parsed in place into an int32_t field of the
+ * destination struct. Units after the number ("dBm", "MHz") are ignored.
+ *
+ * Usage:
+ *   static const struct vendor_xml_tag TAGS[] = {
+ *       {"rssi", offsetof(struct device_metrics, rssi)},
+ *       ...
+ *   };
+ *   static struct vendor_xml_table TABLE = VENDOR_XML_TABLE(TAGS);
+ *   vendor_xml_parse_ints(&TABLE, reply, &metrics);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define VENDOR_XML_SLOTS 64
+#define VENDOR_XML_MAX_TAGS 32
+
+struct vendor_xml_tag {
+    const char *name;
+    size_t offset;
+};
+
+struct vendor_xml_table {
+    const struct vendor_xml_tag *tags;
+    int count;
+    int ready;
+    // index into tags + 1, 0 for the empty slot
+    uint8_t slots[VENDOR_XML_SLOTS];
+};
+
+// A table with more than VENDOR_XML_MAX_TAGS tags does not compile
+#define VENDOR_XML_TABLE(tags) {(tags), sizeof(tags) / sizeof((tags)[0]) + \
+    0 * sizeof(char[sizeof(tags) / sizeof((tags)[0]) <= VENDOR_XML_MAX_TAGS ? 1 : -1]), 0, {0}}
+
+// Tag names differ in length and their first and last letters, which is
+// enough to spread them over the slots without collisions in practice
+static inline uint32_t vendor_xml_hash(const char *name, size_t len) {
+    return (len * 7 + (uint8_t) name[0] * 3 + (uint8_t) name[len - 1]) % VENDOR_XML_SLOTS;
+}
+
+static inline void vendor_xml_init(struct vendor_xml_table *table) {
+    if (table->count > VENDOR_XML_MAX_TAGS) {
+        fprintf(stderr, "vendor_xml: %d tags, only the first %d are parsed\n",
+                table->count, VENDOR_XML_MAX_TAGS);
+    }
+
+    memset(table->slots, 0, sizeof(table->slots));
+    for (int i = 0; i < table->count && i < VENDOR_XML_MAX_TAGS; i += 1) {
+        const char *name = table->tags[i].name;
+        uint32_t slot = vendor_xml_hash(name, strlen(name));
+
+        // the rare collisions are resolved by probing
+        while (table->slots[slot]) {
+            slot = (slot + 1) % VENDOR_XML_SLOTS;
+        }
+        table->slots[slot] = i + 1;
+    }
+    table->ready = 1;
+}
+
+static inline const struct vendor_xml_tag *vendor_xml_lookup(struct vendor_xml_table *table,
+                                                             const char *name, size_t len) {
+    uint32_t slot = vendor_xml_hash(name, len);
+
+    while (table->slots[slot]) {
+        const struct vendor_xml_tag *tag = &table->tags[table->slots[slot] - 1];
+        if (strncmp(tag->name, name, len) == 0 && tag->name[len] == 0) {
+            return tag;
+        }
+        slot = (slot + 1) % VENDOR_XML_SLOTS;
+    }
+    return NULL;
+}
+
+// Parses "[&gt;=|&lt;=|&gt;|&lt;][-]<digits>" and advances the pointer. The
+// numbers out of the int32_t range are clamped to it. Returns 0 if there is
+// no number.
+static inline int vendor_xml_parse_int(const char **pos, int32_t *val) {
+    const char *p = *pos;
+    int64_t sign = 1;
+    int64_t result = 0;
+
+    if (p[0] == '&' && (p[1] == 'g' || p[1] == 'l') && p[2] == 't' && p[3] == ';') {
+        p += 4;
+        if (*p == '=') {
+            p += 1;
+        }
+    }
+
+    if (*p == '-') {
+        sign = -1;
+        p += 1;
+    }
+
+    if (*p < '0' || *p > '9') {
+        return 0;
+    }
+    while (*p >= '0' && *p <= '9') {
+        // the rest of the digits are skipped once it is out of the range
+        if (result <= INT32_MAX) {
+            result = result * 10 + (*p - '0');
+        }
+        p += 1;
+    }
+
+    result *= sign;
+    if (result > INT32_MAX) {
+        result = INT32_MAX;
+    } else if (result < INT32_MIN) {
+        result = INT32_MIN;
+    }
+    *val = result;
+    *pos = p;
+    return 1;
+}
+
+// Returns the number of the tags found
+static inline int vendor_xml_parse_ints(struct vendor_xml_table *table, const char *xml, void *dest) {
+    int found = 0;
+    const char *p = xml;
+
+    if (!table->ready) {
+        vendor_xml_init(table);
+    }
+
+    while ((p = strchr(p, '<')) != NULL) {
+        p += 1;
+
+        // closing tags, declarations and comments
+        if (*p == '/' || *p == '?' || *p == '!') {
+            continue;
+        }
+
+        const char *name = p;
+        while (*p && *p != '>' && *p != ' ' && *p != '/' && *p != '<') {
+            p += 1;
+        }
+        size_t len = p - name;
+
+        while (*p && *p != '>' && *p != '<') {
+            p += 1;
+        }
+        if (*p != '>' || len == 0 || p[-1] == '/') {
+            continue;
+        }
+        p += 1;
+
+        const struct vendor_xml_tag *tag = vendor_xml_lookup(table, name, len);
+        int32_t val;
+        if (tag && vendor_xml_parse_int(&p, &val)) {
+            *(int32_t*)((char*) dest + tag->offset) = val;
+            found += 1;
+        }
+    }
+    return found;
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Compares the vendor_xml.h scanner with the sscanf cascade that used to
+ * parse the "device signal" reply in the signal widget.
+ *
+ * Usage: vendor_xml_bench [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_metrics.h"
+
+static const char *SIGNAL_REPLY =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<response>\n"
+    "<pci>287</pci>\n"
+    "<sc></sc>\n"
+    "<cell_id>26017794</cell_id>\n"
+    "<rssi>&gt;=-51dBm</rssi>\n"
+    "<rsrp>-84dBm</rsrp>\n"
+    "<rsrq>-9.0dB</rsrq>\n"
+    "<sinr>13dB</sinr>\n"
+    "<rscp></rscp>\n"
+    "<ecio></ecio>\n"
+    "<mode>7</mode>\n"
+    "<ulbandwidth>20MHz</ulbandwidth>\n"
+    "<dlbandwidth>20MHz</dlbandwidth>\n"
+    "<txpower>PPusch:9dBm PPucch:-2dBm PSrs:0dBm PPrach:-6dBm</txpower>\n"
+    "<tdd></tdd>\n"
+    "<ul_mcs>mcsUpCarrier1:24</ul_mcs>\n"
+    "<dl_mcs>mcsDownCarrier1Code0:26 mcsDownCarrier1Code1:26</dl_mcs>\n"
+    "<earfcn>DL:1850 UL:19850</earfcn>\n"
+    "<rrc_status>1</rrc_status>\n"
+    "<rac></rac>\n"
+    "<lac></lac>\n"
+    "<tac>4906</tac>\n"
+    "<band>3</band>\n"
+    "<nei_cellid>No1:278No2:286</nei_cellid>\n"
+    "<plmn>25001</plmn>\n"
+    "<ims>0</ims>\n"
+    "<wdlfreq></wdlfreq>\n"
+    "<lteulfreq>17650</lteulfreq>\n"
+    "<ltedlfreq>18600</ltedlfreq>\n"
+    "<transmode>TM[3]</transmode>\n"
+    "<enodeb_id>0101632</enodeb_id>\n"
+    "<cqi0>11</cqi0>\n"
+    "<cqi1>32639</cqi1>\n"
+    "<ulfrequency>1765000kHz</ulfrequency>\n"
+    "<dlfrequency>1860000kHz</dlfrequency>\n"
+    "<arfcn></arfcn>\n"
+    "<bsic></bsic>\n"
+    "<rxlev></rxlev>\n"
+    "</response>\n";
+
+// The parser replaced by vendor_xml_parse_ints, kept as the baseline
+static void sscanf_cascade(const char *buf, struct device_metrics *m) {
+    int offset = 0;
+
+    while (buf[offset]) {
+        int32_t val;
+
+        if (sscanf(&buf[offset], "<rssi>&gt;=%ddBm</rssi>", &val) == 1) {
+            m->rssi = val;
+        } else if (sscanf(&buf[offset], "<rssi>&lt;=%ddBm</rssi>", &val) == 1) {
+            m->rssi = val;
+        } else if (sscanf(&buf[offset], "<rssi>%ddBm</rssi>", &val) == 1) {
+            m->rssi = val;
+        } else if (sscanf(&buf[offset], "<rsrq>%ddB</rsrq>", &val) == 1) {
+            m->rsrq = val;
+        } else if (sscanf(&buf[offset], "<rsrp>%ddBm</rsrp>", &val) == 1) {
+            m->rsrp = val;
+        } else if (sscanf(&buf[offset], "<sinr>%ddB</sinr>", &val) == 1) {
+            m->sinr = val;
+        } else if (sscanf(&buf[offset], "<rscp>%ddBm</rscp>", &val) == 1) {
+            m->rscp = val;
+        } else if (sscanf(&buf[offset], "<ecio>%ddB</ecio>", &val) == 1) {
+            m->ecio = val;
+        } else if (sscanf(&buf[offset], "<ulbandwidth>%dMHz</ulbandwidth>", &val) == 1) {
+            m->ul_bw = val;
+        } else if (sscanf(&buf[offset], "<dlbandwidth>%dMHz</dlbandwidth>", &val) == 1) {
+            m->dl_bw = val;
+        } else if (sscanf(&buf[offset], "<band>%d</band>", &val) == 1) {
+            m->band = val;
+        }
+
+        while (buf[offset] != 0 && buf[offset] != '\n') {
+            offset += 1;
+        }
+        if (buf[offset] == '\n') {
+            offset += 1;
+        }
+    }
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char* argv[]) {
+    static struct vendor_xml_table table = VENDOR_XML_TABLE(DEVICE_SIGNAL_TAGS);
+    struct device_metrics a, b;
+    struct timespec start, end;
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    double cascade_ns, scanner_ns;
+
+    device_metrics_clear_signal(&a);
+    device_metrics_clear_signal(&b);
+    sscanf_cascade(SIGNAL_REPLY, &a);
+    vendor_xml_parse_ints(&table, SIGNAL_REPLY, &b);
+    if (a.rssi != b.rssi || a.rsrp != b.rsrp || a.rsrq != b.rsrq || a.sinr != b.sinr ||
+        a.ul_bw != b.ul_bw || a.dl_bw != b.dl_bw || a.band != b.band) {
+        fprintf(stderr, "The parsers disagree\n");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++) {
+        sscanf_cascade(SIGNAL_REPLY, &a);
+        __asm__ volatile("" : : "r"(&a) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cascade_ns = elapsed_ns(&start, &end) / iterations;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++) {
+        vendor_xml_parse_ints(&table, SIGNAL_REPLY, &b);
+        __asm__ volatile("" : : "r"(&b) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    scanner_ns = elapsed_ns(&start, &end) / iterations;
+
+    printf("sscanf cascade: %.0f ns/reply\n", cascade_ns);
+    printf("vendor_xml:     %.0f ns/reply\n", scanner_ns);
+    printf("speedup:        %.1fx\n", cascade_ns / scanner_ns);
+    return 0;
+}
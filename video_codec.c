@@ -0,0 +1,257 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "video_codec.h"
+
+// ------------------------------ VIDEO CODEC ------------------------------
+// The format is described in video_codec.h. The decoder is linked into the
+// hijack library, the encoder into the video_encoder tool.
+
+// Returns -1 if the depth is not supported on the screen
+int video_codec_init(struct video_codec *codec, int small_screen, uint8_t depth) {
+    // 16 pixels per word on the small screen, one on the color one
+    uint32_t pixels_per_word = small_screen ? 16 : 1;
+    uint32_t rows = small_screen ? 64 : 128;
+
+    if (depth > VIDEO_DEPTH_MONO || (small_screen && depth != VIDEO_DEPTH_NATIVE)) {
+        return -1;
+    }
+
+    codec->small_screen = small_screen;
+    codec->depth = depth;
+    codec->screen_words = 128 / pixels_per_word * rows;
+
+    if (depth == VIDEO_DEPTH_GRAY4) {
+        pixels_per_word = 4;
+    } else if (depth == VIDEO_DEPTH_MONO) {
+        pixels_per_word = 16;
+    }
+
+    codec->row_words = 128 / pixels_per_word;
+    codec->frame_words = codec->row_words * rows;
+    codec->tile_words = VIDEO_TILE_WIDTH / pixels_per_word;
+    codec->tiles_x = codec->row_words / codec->tile_words;
+    codec->tiles_y = rows / VIDEO_TILE_HEIGHT;
+    codec->has_keyframe = 0;
+    return 0;
+}
+
+// 0 to 255 from the byte swapped RGB565 pixel
+static uint8_t pixel_luma(uint16_t pixel) {
+    uint16_t color = (pixel >> 8) | (pixel << 8);
+    uint32_t red = (color >> 11) << 3;
+    uint32_t green = ((color >> 5) & 0x3f) << 2;
+    uint32_t blue = (color & 0x1f) << 3;
+
+    return (red * 77 + green * 150 + blue * 29) >> 8;
+}
+
+// The byte swapped RGB565 gray of the 4-bit level
+static uint16_t gray_pixel(uint8_t level) {
+    uint16_t five = (level << 1) | (level >> 3);
+    uint16_t six = (level << 2) | (level >> 2);
+    uint16_t color = (five << 11) | (six << 5) | five;
+
+    return (color >> 8) | (color << 8);
+}
+
+// The screen buffer into the words of the frame at the depth of the codec
+void video_pack(struct video_codec *codec, const uint16_t *screen, uint16_t *frame) {
+    if (codec->depth == VIDEO_DEPTH_NATIVE) {
+        memcpy(frame, screen, codec->screen_words * sizeof(uint16_t));
+        return;
+    }
+
+    uint32_t bits = codec->depth == VIDEO_DEPTH_GRAY4 ? 4 : 1;
+    uint32_t pixels_per_word = 16 / bits;
+
+    for (uint32_t i = 0; i < codec->frame_words; i += 1) {
+        uint16_t word = 0;
+        for (uint32_t p = 0; p < pixels_per_word; p += 1) {
+            uint8_t luma = pixel_luma(screen[i * pixels_per_word + p]);
+            word |= (bits == 4 ? luma >> 4 : luma >> 7) << (p * bits);
+        }
+        frame[i] = word;
+    }
+}
+
+void video_unpack(struct video_codec *codec, const uint16_t *frame, uint16_t *screen) {
+    if (codec->depth == VIDEO_DEPTH_NATIVE) {
+        memcpy(screen, frame, codec->screen_words * sizeof(uint16_t));
+        return;
+    }
+
+    if (codec->depth == VIDEO_DEPTH_MONO) {
+        for (uint32_t i = 0; i < codec->frame_words; i += 1) {
+            uint16_t word = frame[i];
+            for (uint32_t p = 0; p < 16; p += 1) {
+                *screen++ = (word >> p) & 1 ? 0xffff : 0;
+            }
+        }
+        return;
+    }
+
+    uint16_t grays[16];
+    for (uint8_t level = 0; level < 16; level += 1) {
+        grays[level] = gray_pixel(level);
+    }
+    for (uint32_t i = 0; i < codec->frame_words; i += 1) {
+        uint16_t word = frame[i];
+        screen[0] = grays[word & 0xf];
+        screen[1] = grays[(word >> 4) & 0xf];
+        screen[2] = grays[(word >> 8) & 0xf];
+        screen[3] = grays[word >> 12];
+        screen += 4;
+    }
+}
+
+uint32_t video_rle_encode(const uint16_t *words, uint32_t count, uint8_t *out) {
+    uint32_t pos = 0;
+    uint32_t i = 0;
+
+    while (i < count) {
+        uint32_t run = 1;
+        while (i + run < count && run < 129 && words[i + run] == words[i]) {
+            run += 1;
+        }
+
+        if (run >= 2) {
+            out[pos++] = run + 126;
+            memcpy(&out[pos], &words[i], sizeof(uint16_t));
+            pos += sizeof(uint16_t);
+            i += run;
+            continue;
+        }
+
+        // literals up to the next run
+        uint32_t start = i;
+        i += 1;
+        while (i < count && i - start < 128 && !(i + 1 < count && words[i + 1] == words[i])) {
+            i += 1;
+        }
+
+        out[pos++] = i - start - 1;
+        memcpy(&out[pos], &words[start], (i - start) * sizeof(uint16_t));
+        pos += (i - start) * sizeof(uint16_t);
+    }
+    return pos;
+}
+
+// Returns 0 if the input is exactly count words, -1 otherwise
+int video_rle_decode(const uint8_t *in, uint32_t len, uint16_t *words, uint32_t count) {
+    uint32_t pos = 0;
+    uint32_t i = 0;
+
+    while (pos < len) {
+        uint8_t control = in[pos++];
+
+        if (control <= 127) {
+            uint32_t n = control + 1;
+            if (pos + n * sizeof(uint16_t) > len || i + n > count) {
+                return -1;
+            }
+            memcpy(&words[i], &in[pos], n * sizeof(uint16_t));
+            pos += n * sizeof(uint16_t);
+            i += n;
+        } else {
+            uint32_t n = control - 126;
+            uint16_t word;
+            if (pos + sizeof(uint16_t) > len || i + n > count) {
+                return -1;
+            }
+            memcpy(&word, &in[pos], sizeof(uint16_t));
+            pos += sizeof(uint16_t);
+            while (n--) {
+                words[i++] = word;
+            }
+        }
+    }
+    return i == count ? 0 : -1;
+}
+
+static uint32_t tile_offset(struct video_codec *codec, uint32_t tile, uint32_t row) {
+    uint32_t tile_x = tile % codec->tiles_x;
+    uint32_t tile_y = tile / codec->tiles_x;
+
+    return (tile_y * VIDEO_TILE_HEIGHT + row) * codec->row_words + tile_x * codec->tile_words;
+}
+
+uint32_t video_encode_key(struct video_codec *codec, const uint16_t *frame, uint8_t *out) {
+    return video_rle_encode(frame, codec->frame_words, out);
+}
+
+uint32_t video_encode_delta(struct video_codec *codec, const uint16_t *prev, const uint16_t *frame, uint8_t *out) {
+    uint32_t tiles = codec->tiles_x * codec->tiles_y;
+    uint32_t bitmap_len = (tiles + 7) / 8;
+    uint32_t tile_row_size = codec->tile_words * sizeof(uint16_t);
+    uint32_t words = 0;
+
+    memset(out, 0, bitmap_len);
+
+    for (uint32_t tile = 0; tile < tiles; tile += 1) {
+        int changed = 0;
+        for (uint32_t row = 0; row < VIDEO_TILE_HEIGHT && !changed; row += 1) {
+            uint32_t offset = tile_offset(codec, tile, row);
+            changed = memcmp(&prev[offset], &frame[offset], tile_row_size) != 0;
+        }
+        if (!changed) {
+            continue;
+        }
+
+        out[tile / 8] |= 1 << (tile % 8);
+        for (uint32_t row = 0; row < VIDEO_TILE_HEIGHT; row += 1) {
+            memcpy(&codec->tile_buf[words], &frame[tile_offset(codec, tile, row)], tile_row_size);
+            words += codec->tile_words;
+        }
+    }
+
+    return bitmap_len + video_rle_encode(codec->tile_buf, words, out + bitmap_len);
+}
+
+// Applies the packet to the frame, returns -1 if it is broken
+int video_decode(struct video_codec *codec, uint8_t type, const uint8_t *payload, uint32_t len, uint16_t *frame) {
+    if (type == VIDEO_PACKET_KEY) {
+        if (video_rle_decode(payload, len, frame, codec->frame_words) != 0) {
+            return -1;
+        }
+        codec->has_keyframe = 1;
+        return 0;
+    }
+
+    if (type != VIDEO_PACKET_DELTA) {
+        return -1;
+    }
+    if (!codec->has_keyframe) {
+        return 0;
+    }
+
+    uint32_t tiles = codec->tiles_x * codec->tiles_y;
+    uint32_t bitmap_len = (tiles + 7) / 8;
+    uint32_t tile_row_size = codec->tile_words * sizeof(uint16_t);
+    uint32_t words = 0;
+
+    if (len < bitmap_len) {
+        return -1;
+    }
+    for (uint32_t tile = 0; tile < tiles; tile += 1) {
+        if (payload[tile / 8] & (1 << (tile % 8))) {
+            words += codec->tile_words * VIDEO_TILE_HEIGHT;
+        }
+    }
+
+    if (video_rle_decode(payload + bitmap_len, len - bitmap_len, codec->tile_buf, words) != 0) {
+        return -1;
+    }
+
+    words = 0;
+    for (uint32_t tile = 0; tile < tiles; tile += 1) {
+        if (!(payload[tile / 8] & (1 << (tile % 8)))) {
+            continue;
+        }
+        for (uint32_t row = 0; row < VIDEO_TILE_HEIGHT; row += 1) {
+            memcpy(&frame[tile_offset(codec, tile, row)], &codec->tile_buf[words], tile_row_size);
+            words += codec->tile_words;
+        }
+    }
+    return 0;
+}
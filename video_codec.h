@@ -0,0 +1,103 @@
+#ifndef VIDEO_CODEC_H
+#define VIDEO_CODEC_H
+
+/*
+ * Compressed video stream. The client sends VIDEO_CODEC_MAGIC on connect, a
+ * server that knows the format answers with it and sends packets, the old
+ * servers ignore it and send raw frames.
+ *
+ * The frames are the screen buffers as is: byte swapped RGB565 on the color
+ * screen, 1 bit per pixel on the small one. Both are handled as little
+ * endian 16-bit words, rows of 128 pixels.
+ *
+ * A packet is a video_packet_header and the payload:
+ *   key frame    the words of the frame, run length encoded
+ *   delta frame  a bitmap of the changed tiles of 16x8 pixels, bit i % 8 of
+ *                byte i / 8 for the tile i in row-major order, then the words
+ *                of the changed tiles, row by row in every tile, run length
+ *                encoded together
+ *
+ * The run length encoding is PackBits over words: a control byte c <= 127
+ * is followed by c + 1 literal words, c >= 128 by a word repeated c - 126
+ * times.
+ *
+ * The depth in the header tells how the frame is packed into the words, on
+ * the color screen it can be lowered when the link is slow:
+ *   native  the screen buffer as is
+ *   gray4   4-bit grayscale, pixel i in bits 4 * (i % 4) of word i / 4
+ *   mono    1 bit per pixel, pixel i in bit i % 16 of word i / 16
+ * A new depth always starts with a key frame. The small screen is native
+ * only.
+ *
+ * The client asks for a quality with a video_control message at any time
+ * after the handshake: the depth and to send every frame_step-th frame of
+ * the source only.
+ */
+
+#include <stdint.h>
+
+#define VIDEO_CODEC_MAGIC "VID1"
+#define VIDEO_CODEC_MAGIC_LEN 4
+
+#define VIDEO_PACKET_KEY 'K'
+#define VIDEO_PACKET_DELTA 'D'
+
+#define VIDEO_CONTROL_QUALITY 'Q'
+
+#define VIDEO_DEPTH_NATIVE 0
+#define VIDEO_DEPTH_GRAY4 1
+#define VIDEO_DEPTH_MONO 2
+
+#define VIDEO_TILE_WIDTH 16
+#define VIDEO_TILE_HEIGHT 8
+
+// the color screen, 128x128 pixels of 16 bits
+#define VIDEO_MAX_WORDS (128 * 128)
+#define VIDEO_MAX_TILES ((128 / VIDEO_TILE_WIDTH) * (128 / VIDEO_TILE_HEIGHT))
+// a control byte per 128 literal words in the worst case
+#define VIDEO_MAX_PAYLOAD (VIDEO_MAX_TILES / 8 + VIDEO_MAX_WORDS * 2 + VIDEO_MAX_WORDS / 128 + 1)
+
+struct video_packet_header {
+    uint8_t type;
+    uint8_t depth;
+    uint8_t reserved[2];
+    // of the payload, little endian
+    uint32_t length;
+};
+
+struct video_control {
+    uint8_t type;
+    uint8_t depth;
+    uint8_t frame_step;
+    uint8_t reserved;
+};
+
+struct video_codec {
+    int small_screen;
+    uint8_t depth;
+    // of the screen buffer and of the packed frame
+    uint32_t screen_words;
+    uint32_t frame_words;
+    uint32_t row_words;
+    uint32_t tile_words;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    // the delta frames before the first key frame are skipped, the encoder
+    // starts with a key frame too
+    int has_keyframe;
+    // the words of the changed tiles
+    uint16_t tile_buf[VIDEO_MAX_WORDS];
+};
+
+int video_codec_init(struct video_codec *codec, int small_screen, uint8_t depth);
+void video_pack(struct video_codec *codec, const uint16_t *screen, uint16_t *frame);
+void video_unpack(struct video_codec *codec, const uint16_t *frame, uint16_t *screen);
+
+uint32_t video_rle_encode(const uint16_t *words, uint32_t count, uint8_t *out);
+int video_rle_decode(const uint8_t *in, uint32_t len, uint16_t *words, uint32_t count);
+
+uint32_t video_encode_key(struct video_codec *codec, const uint16_t *frame, uint8_t *out);
+uint32_t video_encode_delta(struct video_codec *codec, const uint16_t *prev, const uint16_t *frame, uint8_t *out);
+int video_decode(struct video_codec *codec, uint8_t type, const uint8_t *payload, uint32_t len, uint16_t *frame);
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * Reference encoder of the compressed video stream, see video_codec.h.
+ * Encodes raw frames, the format the old servers send, from stdin into a
+ * stream on stdout. With -d decodes a stream back into raw frames, so
+ *   video_encoder < frames | video_encoder -d | cmp - frames
+ * checks the codec.
+ *
+ * With -l serves the raw frames from stdin in a loop over TCP, to one
+ * client at a time like the video server: compressed to the clients that
+ * send the hello, raw to the others. The quality the client asks for is
+ * honored. -r sets the frame rate and -j delays every frame by up to the
+ * given ms more, -b limits the rate to the given KB/sec, to test the
+ * receiver.
+ *
+ * Usage: video_encoder [-s] [-k keyframe_interval] [-d]
+ *        video_encoder [-s] [-k keyframe_interval] -l port [-r fps] [-j jitter_ms] [-b kb_per_sec]
+ *   -s  frames of the small screen, 128x64 at 1 bit per pixel
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "video_codec.h"
+
+static struct video_codec codec;
+static uint32_t frame_size;
+static uint16_t frame[VIDEO_MAX_WORDS];
+static uint16_t prev[VIDEO_MAX_WORDS];
+static uint8_t key_buf[VIDEO_MAX_PAYLOAD];
+static uint8_t delta_buf[VIDEO_MAX_PAYLOAD];
+
+static int read_full(void *buf, size_t size) {
+    return fread(buf, 1, size, stdin) == size;
+}
+
+// The packed frame with the given number as a key frame on the interval,
+// after a new depth or when it is smaller than the delta to the previous one
+static uint8_t encode_frame(uint32_t num, uint32_t keyframe_interval, const uint16_t *from,
+                            const uint8_t **payload, uint32_t *len) {
+    uint32_t key_len = video_encode_key(&codec, from, key_buf);
+    uint32_t delta_len = key_len;
+
+    if (codec.has_keyframe && num % keyframe_interval != 0) {
+        delta_len = video_encode_delta(&codec, prev, from, delta_buf);
+    }
+    memcpy(prev, from, codec.frame_words * sizeof(uint16_t));
+
+    if (delta_len < key_len) {
+        *payload = delta_buf;
+        *len = delta_len;
+        return VIDEO_PACKET_DELTA;
+    }
+    codec.has_keyframe = 1;
+    *payload = key_buf;
+    *len = key_len;
+    return VIDEO_PACKET_KEY;
+}
+
+static int encode(uint32_t keyframe_interval) {
+    uint64_t raw_bytes = 0;
+    uint64_t stream_bytes = VIDEO_CODEC_MAGIC_LEN;
+    uint32_t frames = 0;
+    uint32_t keyframes = 0;
+
+    fwrite(VIDEO_CODEC_MAGIC, 1, VIDEO_CODEC_MAGIC_LEN, stdout);
+
+    while (read_full(frame, frame_size)) {
+        struct video_packet_header header = {0};
+        const uint8_t *payload;
+
+        header.type = encode_frame(frames, keyframe_interval, frame, &payload, &header.length);
+        fwrite(&header, sizeof(header), 1, stdout);
+        fwrite(payload, 1, header.length, stdout);
+
+        stream_bytes += sizeof(header) + header.length;
+        keyframes += header.type == VIDEO_PACKET_KEY;
+        raw_bytes += frame_size;
+        frames += 1;
+    }
+
+    fprintf(stderr, "%u frames, %u key frames, %llu bytes raw, %llu bytes encoded (%.1f%%)\n",
+            frames, keyframes, (unsigned long long) raw_bytes, (unsigned long long) stream_bytes,
+            raw_bytes ? 100.0 * stream_bytes / raw_bytes : 0);
+    return 0;
+}
+
+static int decode() {
+    struct video_packet_header header;
+    char magic[VIDEO_CODEC_MAGIC_LEN];
+    uint16_t screen[VIDEO_MAX_WORDS];
+
+    if (!read_full(magic, sizeof(magic)) || memcmp(magic, VIDEO_CODEC_MAGIC, VIDEO_CODEC_MAGIC_LEN) != 0) {
+        fprintf(stderr, "Not a video stream\n");
+        return 1;
+    }
+
+    while (read_full(&header, sizeof(header))) {
+        if (header.length > VIDEO_MAX_PAYLOAD || !read_full(key_buf, header.length)) {
+            fprintf(stderr, "Truncated packet\n");
+            return 1;
+        }
+        if (header.depth != codec.depth && video_codec_init(&codec, codec.small_screen, header.depth) != 0) {
+            fprintf(stderr, "Unsupported depth %d\n", header.depth);
+            return 1;
+        }
+        if (video_decode(&codec, header.type, key_buf, header.length, frame) != 0) {
+            fprintf(stderr, "Broken packet\n");
+            return 1;
+        }
+        video_unpack(&codec, frame, screen);
+        fwrite(screen, 1, frame_size, stdout);
+    }
+    return 0;
+}
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// With a rate in bytes per second sends a chunk at a time like a slow link
+static int send_full(int sock, const void *buf, uint32_t len, uint32_t rate) {
+    const uint32_t CHUNK = 512;
+
+    while (len) {
+        uint32_t size = rate && len > CHUNK ? CHUNK : len;
+        ssize_t ret = send(sock, buf, size, MSG_NOSIGNAL);
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return -1;
+        }
+        buf = (const uint8_t *) buf + ret;
+        len -= ret;
+        if (rate) {
+            usleep((uint64_t) ret * 1000000 / rate);
+        }
+    }
+    return 0;
+}
+
+// Applies the quality messages of the client, returns -1 if it is gone
+static int read_controls(int sock, uint32_t *frame_step) {
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    struct video_control control;
+
+    while (poll(&pfd, 1, 0) == 1) {
+        if (recv(sock, &control, sizeof(control), MSG_WAITALL) != sizeof(control)) {
+            return -1;
+        }
+        if (control.type != VIDEO_CONTROL_QUALITY || control.frame_step == 0) {
+            continue;
+        }
+        if (control.depth != codec.depth && video_codec_init(&codec, codec.small_screen, control.depth) != 0) {
+            fprintf(stderr, "Unsupported depth %d\n", control.depth);
+            continue;
+        }
+        *frame_step = control.frame_step;
+        fprintf(stderr, "Quality: depth %d, every %u frames\n", codec.depth, *frame_step);
+    }
+    return 0;
+}
+
+static void serve_client(int sock, const uint8_t *frames, uint32_t count, uint32_t keyframe_interval,
+                         int fps, int jitter_ms, uint32_t rate) {
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    char hello[VIDEO_CODEC_MAGIC_LEN] = {0};
+    int compressed = 0;
+    uint32_t frame_step = 1;
+
+    // the old clients send nothing
+    if (poll(&pfd, 1, 1000) == 1 && recv(sock, hello, sizeof(hello), MSG_WAITALL) == sizeof(hello)) {
+        compressed = memcmp(hello, VIDEO_CODEC_MAGIC, VIDEO_CODEC_MAGIC_LEN) == 0;
+    }
+    fprintf(stderr, "Client connected, %s frames\n", compressed ? "compressed" : "raw");
+
+    if (compressed && send_full(sock, VIDEO_CODEC_MAGIC, VIDEO_CODEC_MAGIC_LEN, 0) != 0) {
+        return;
+    }
+    video_codec_init(&codec, codec.small_screen, VIDEO_DEPTH_NATIVE);
+
+    for (uint32_t num = 0, sent = 0;; num += frame_step, sent += 1) {
+        const uint16_t *from = (const uint16_t *) &frames[(num % count) * frame_size];
+        uint64_t start = now_us();
+
+        if (compressed) {
+            struct video_packet_header header = {0};
+            const uint8_t *payload;
+
+            if (read_controls(sock, &frame_step) != 0) {
+                break;
+            }
+            video_pack(&codec, from, frame);
+            header.type = encode_frame(sent, keyframe_interval, frame, &payload, &header.length);
+            header.depth = codec.depth;
+            if (send_full(sock, &header, sizeof(header), rate) != 0 ||
+                send_full(sock, payload, header.length, rate) != 0) {
+                break;
+            }
+        } else if (send_full(sock, from, frame_size, rate) != 0) {
+            break;
+        }
+
+        // the frames skipped on a lower frame rate keep the playback speed
+        uint64_t delay_us = (uint64_t) frame_step * 1000000 / fps;
+        uint64_t spent = now_us() - start;
+        if (jitter_ms) {
+            delay_us += rand() % (jitter_ms * 1000);
+        }
+        if (delay_us > spent) {
+            usleep(delay_us - spent);
+        }
+    }
+    fprintf(stderr, "Client disconnected\n");
+}
+
+static int serve(int port, uint32_t keyframe_interval, int fps, int jitter_ms, uint32_t rate) {
+    uint8_t *frames = NULL;
+    uint32_t count = 0;
+
+    for (;;) {
+        uint8_t *grown = realloc(frames, (count + 1) * frame_size);
+        if (!grown) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        frames = grown;
+        if (!read_full(&frames[count * frame_size], frame_size)) {
+            break;
+        }
+        count += 1;
+    }
+    if (count == 0) {
+        fprintf(stderr, "No frames on stdin\n");
+        return 1;
+    }
+
+    int listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY)};
+
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(listen_sock, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(listen_sock, 1) == -1) {
+        fprintf(stderr, "Failed to listen on port %d: %s\n", port, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "Serving %u frames on port %d\n", count, port);
+
+    for (;;) {
+        int sock = accept(listen_sock, NULL, NULL);
+        if (sock == -1) {
+            continue;
+        }
+        serve_client(sock, frames, count, keyframe_interval, fps, jitter_ms, rate);
+        close(sock);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int small_screen = 0;
+    int decode_mode = 0;
+    long keyframe_interval = 100;
+    int port = 0;
+    int fps = 32;
+    int jitter_ms = 0;
+    int kb_per_sec = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "sk:dl:r:j:b:")) != -1) {
+        if (opt == 's') {
+            small_screen = 1;
+        } else if (opt == 'k') {
+            keyframe_interval = strtol(optarg, NULL, 10);
+        } else if (opt == 'd') {
+            decode_mode = 1;
+        } else if (opt == 'l') {
+            port = atoi(optarg);
+        } else if (opt == 'r') {
+            fps = atoi(optarg);
+        } else if (opt == 'j') {
+            jitter_ms = atoi(optarg);
+        } else if (opt == 'b') {
+            kb_per_sec = atoi(optarg);
+        } else {
+            fprintf(stderr, "Usage: %s [-s] [-k keyframe_interval] [-d] [-l port [-r fps] [-j jitter_ms] [-b kb_per_sec]]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (keyframe_interval < 1) {
+        keyframe_interval = 1;
+    }
+    if (fps < 1) {
+        fps = 1;
+    }
+    if (jitter_ms < 0) {
+        jitter_ms = 0;
+    }
+    if (kb_per_sec < 0) {
+        kb_per_sec = 0;
+    }
+
+    video_codec_init(&codec, small_screen, VIDEO_DEPTH_NATIVE);
+    frame_size = codec.frame_words * sizeof(uint16_t);
+
+    if (port) {
+        return serve(port, keyframe_interval, fps, jitter_ms, kb_per_sec * 1024);
+    }
+    return decode_mode ? decode() : encode(keyframe_interval);
+}
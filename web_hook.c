@@ -12,6 +12,20 @@
  * Used to get radio mode configuration (./client net net-mode 1 1),
  * toggle Wi-Fi Extender mode (./client wlan handover-setting 1 1) etc.
  *
+ * Replies can also be subscribed to: the hook polls the handler once for all
+ * subscribers and pushes only changed replies, e.g.
+ * ./client -s 1000 device signal 1 1
+ * See web_hook.h for the wire format.
+ *
+ * Per endpoint counters and latency histograms are printed by ./client -S
+ *
+ * With -DHOOK -DBENCH it builds a load generator instead: the server runs
+ * against fake vendor hooks and client threads drive it, see bench_usage().
+ *
+ * With -DMETRICS_FILE='"/var/device_metrics"' the hook also publishes the
+ * hottest metrics into a seqlock-guarded page, see device_metrics.h. Their
+ * vendor hooks are only polled while the page has readers.
+ *
  * Compile:
  * arm-linux-androideabi-gcc -shared -ldl -fPIC -pthread -DHOOK -DSOCK_NAME='"/var/webhook"' -O2 -D__ANDROID_API__=19 -s -o web_hook.so web_hook.c
  * arm-linux-androideabi-gcc -fPIC -DCLIENT -DSOCK_NAME='"/var/webhook"' -O2 -D__ANDROID_API__=19 -s -o web_hook_client web_hook.c
@@ -19,14 +33,23 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <dlfcn.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <pthread.h>
 
+#include "web_hook.h"
+#include "device_metrics.h"
+
 // UNIX socket name to listen/connect to
 #if !defined(SOCK_NAME)
 #error "You should define SOCK_NAME"
@@ -36,17 +59,29 @@
 #error "You should define either -DHOOK or -DCLIENT"
 #endif
 
+#if defined(BENCH) && !defined(HOOK)
+#error "-DBENCH needs -DHOOK"
+#endif
+
 #define BUFSIZE 8192
 
 // Building web_hook.so
 #ifdef HOOK
-#define HOOK_NUMBER 50
+// Registered hooks live in an open-addressing hash table keyed by the
+// interned subsystem name. It grows when half full, so there is no fixed
+// limit on the number of subsystems.
+#define HOOK_TABLE_INITIAL_SIZE 64
 struct webhook_function_s {
     const char* subsystemname;
+    uint32_t hash;
     void* hookfunction;
 };
-static struct webhook_function_s webhook_functions[HOOK_NUMBER];
-static int webhook_functions_count = 0;
+static struct webhook_function_s *webhook_functions = NULL;
+static size_t webhook_functions_size = 0;
+static size_t webhook_functions_count = 0;
+
+// Registration runs in the host process threads, lookups in web_hookserver
+static pthread_mutex_t webhook_functions_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Pointer to real "webserver_register_hookfunction" function
 static void* (*webserver_r_h_real)(
@@ -58,35 +93,107 @@ static ssize_t (*readlink_real)(const char *pathname, char *buf, size_t bufsiz)
 // Pointer to real "global_release_msg" function
 static void (*global_release_msg_real)(void *ptr) = NULL;
 
-// Search for registered web handlers and return pointer to hook function if found
-static void* int_get_webhook(const char* name) {
-    int i;
+#ifdef BENCH
+static void* bench_register_hookfunction_real(int subsystemnum, const char *subsystemname,
+                                              void* hookfunction, void* global_release_msg);
+#endif
 
-    if (!webhook_functions_count)
-        return NULL;
-    if (!name || strlen(name) == 0)
-        return NULL;
-    for (i = 0; i < webhook_functions_count; i++) {
-        if (strcmp(name, webhook_functions[i].subsystemname) == 0) {
-            fprintf(stderr, "[int_get_webhook] found func %d %s\n", i,
-                webhook_functions[i].subsystemname);
-            return webhook_functions[i].hookfunction;
+// FNV-1a, continued from the hash of a prefix
+static uint32_t int_hash_continue(uint32_t hash, const char* name) {
+    while (*name) {
+        hash ^= (uint8_t) *name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t int_hash_name(const char* name) {
+    return int_hash_continue(2166136261u, name);
+}
+
+// Returns the slot holding the name or the empty slot where it should go.
+// The table size is always a power of two and never full.
+static struct webhook_function_s* int_find_slot(struct webhook_function_s* table, size_t size,
+                                                const char* name, uint32_t hash) {
+    size_t mask = size - 1;
+    size_t i = hash & mask;
+
+    while (table[i].subsystemname) {
+        if (table[i].hash == hash && strcmp(table[i].subsystemname, name) == 0) {
+            break;
         }
+        i = (i + 1) & mask;
     }
-    fprintf(stderr, "[int_get_webhook] %s not found\n", name);
-    return NULL;
+    return &table[i];
+}
+
+static int int_grow_webhooks() {
+    size_t new_size = webhook_functions_size ? webhook_functions_size * 2 : HOOK_TABLE_INITIAL_SIZE;
+    struct webhook_function_s *new_table = calloc(new_size, sizeof(struct webhook_function_s));
+    if (!new_table) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < webhook_functions_size; i++) {
+        struct webhook_function_s *old = &webhook_functions[i];
+        if (old->subsystemname) {
+            *int_find_slot(new_table, new_size, old->subsystemname, old->hash) = *old;
+        }
+    }
+
+    free(webhook_functions);
+    webhook_functions = new_table;
+    webhook_functions_size = new_size;
+    return 1;
+}
+
+// Search for registered web handlers and return pointer to hook function if found.
+// The hash of the name goes to *hash unless it is NULL, see int_get_stats().
+static void* int_get_webhook(const char* name, uint32_t *hash) {
+    void* hookfunction = NULL;
+    uint32_t name_hash;
+
+    if (!name || !name[0])
+        return NULL;
+
+    name_hash = int_hash_name(name);
+    if (hash) {
+        *hash = name_hash;
+    }
+
+    pthread_mutex_lock(&webhook_functions_lock);
+    if (webhook_functions_count) {
+        hookfunction = int_find_slot(webhook_functions, webhook_functions_size,
+                                     name, name_hash)->hookfunction;
+    }
+    pthread_mutex_unlock(&webhook_functions_lock);
+    return hookfunction;
 }
 
 // Register hookfunction for given subsystemname
 static int int_register_webhook(const char *subsystemname,
                                 void* hookfunction)
 {
-    if (webhook_functions_count >= HOOK_NUMBER)
+    struct webhook_function_s *slot;
+    uint32_t hash = int_hash_name(subsystemname);
+
+    pthread_mutex_lock(&webhook_functions_lock);
+    if ((webhook_functions_count + 1) * 2 > webhook_functions_size && !int_grow_webhooks()) {
+        pthread_mutex_unlock(&webhook_functions_lock);
+        fprintf(stderr, "[int_register_webhook] "
+                        "Out of memory registering %s\n", subsystemname);
         return 0;
+    }
+
+    slot = int_find_slot(webhook_functions, webhook_functions_size, subsystemname, hash);
+    if (!slot->subsystemname) {
+        slot->subsystemname = strdup(subsystemname);
+        slot->hash = hash;
+        webhook_functions_count++;
+    }
+    slot->hookfunction = hookfunction;
+    pthread_mutex_unlock(&webhook_functions_lock);
 
-    webhook_functions[webhook_functions_count].subsystemname = strdup(subsystemname);
-    webhook_functions[webhook_functions_count].hookfunction = hookfunction;
-    webhook_functions_count++;
     fprintf(stderr, "[int_register_webhook] "
                     "Webhook for %s registered successfully!\n", subsystemname);
 
@@ -119,68 +226,646 @@ static int create_socket(char* path) {
     return fd;
 }
 
-// Socket server handler
-static void* web_hookserver(void* nothing) {
-    int fd, client;
-    ssize_t rsize;
-    char buf[BUFSIZE];
+typedef void* (*webhook_func_t)(const char *function_name,
+                                int req_type_get_post,
+                                char *req_body,
+                                size_t req_size);
+
+// Subscriptions. Every distinct (subsystem, function, reqtype, data) request
+// is a feed, polled once per the shortest interval of its subscribers. Only
+// replies that differ from the previous one are pushed to the subscribers.
+#define MAX_FEEDS 16
+#define MAX_SUBSCRIBERS 32
+#define MIN_FEED_INTERVAL_MS 100
+
+struct webhook_feed_s {
+    webhook_func_t webfunc;
+    char subsystemname[32];
+    char libfunction[64];
+    char data[256];
+    int reqtype;
+    uint32_t interval_ms;
+    uint64_t next_poll_ms;
+    char *last_reply;
+    size_t last_reply_len;
+    // internal feeds stay alive without subscribers, they check for readers
+    // at this interval and are polled as often as readers_interval_ms()
+    // says, 0 while nobody uses their replies
+    uint32_t pinned_interval_ms;
+    uint32_t (*readers_interval_ms)();
+    uint64_t polled_ms;
+    struct webhook_stats_s *stats;
+    // called after every poll that got a reply
+    void (*on_poll)(struct webhook_feed_s *feed, int changed);
+};
+
+struct webhook_subscriber_s {
+    int fd;
+    uint32_t interval_ms;
+    struct webhook_feed_s *feed;
+};
+
+static struct webhook_feed_s *feeds[MAX_FEEDS];
+static struct webhook_subscriber_s subscribers[MAX_SUBSCRIBERS];
+static int subscribers_count = 0;
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Per endpoint statistics, requested with "@stats". Only the server thread
+// writes them, the counters are atomic so that a reader never sees torn values.
+// An entry is keyed by the hash of "<subsystem>/<function>", continued from
+// the hash of the subsystem name the hook lookup has already computed.
+// Latencies of webfunc calls go to log2 buckets: bucket i counts calls that
+// took [2^(i-1), 2^i) microseconds.
+#define STATS_SIZE 256
+#define STATS_BUCKETS 24
+
+struct webhook_stats_s {
+    char subsystemname[32];
+    char libfunction[64];
+    uint32_t hash;
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t bytes_out;
+    uint64_t time_us;
+    uint64_t histogram[STATS_BUCKETS];
+};
+
+static struct webhook_stats_s endpoint_stats[STATS_SIZE];
+static int endpoint_stats_count = 0;
+// shared by all endpoints that don't fit in the table
+static struct webhook_stats_s other_endpoint_stats = {.subsystemname = "other"};
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The subsystem_hash is int_hash_name(subsystemname)
+static struct webhook_stats_s* int_get_stats(const char *subsystemname, uint32_t subsystem_hash,
+                                             const char *libfunction) {
+    uint32_t hash = int_hash_continue(int_hash_continue(subsystem_hash, "/"), libfunction);
+    size_t i;
+
+    for (i = hash % STATS_SIZE; endpoint_stats[i].subsystemname[0]; i = (i + 1) % STATS_SIZE) {
+        if (endpoint_stats[i].hash == hash &&
+            strcmp(endpoint_stats[i].libfunction, libfunction) == 0 &&
+            strcmp(endpoint_stats[i].subsystemname, subsystemname) == 0) {
+            return &endpoint_stats[i];
+        }
+    }
+
+    // keep some room so that the probing always ends
+    if (endpoint_stats_count >= STATS_SIZE * 3 / 4) {
+        return &other_endpoint_stats;
+    }
+    strncpy(endpoint_stats[i].subsystemname, subsystemname, sizeof(endpoint_stats[i].subsystemname) - 1);
+    strncpy(endpoint_stats[i].libfunction, libfunction, sizeof(endpoint_stats[i].libfunction) - 1);
+    endpoint_stats[i].hash = hash;
+    endpoint_stats_count++;
+    return &endpoint_stats[i];
+}
+
+static void int_stats_add(uint64_t *counter, uint64_t val) {
+    __atomic_fetch_add(counter, val, __ATOMIC_RELAXED);
+}
+
+// Calls the vendor hook and accounts the call to its endpoint
+static void* int_call_webfunc(struct webhook_stats_s *stats, webhook_func_t webfunc,
+                              const char *libfunction, int reqtype, char *data) {
+    uint64_t start = now_us();
+    void *ret = webfunc(libfunction, reqtype, data, strlen(data));
+    uint64_t elapsed = now_us() - start;
+    int bucket = 0;
+
+    while (bucket < STATS_BUCKETS - 1 && (elapsed >> bucket)) {
+        bucket++;
+    }
+
+    int_stats_add(&stats->requests, 1);
+    int_stats_add(&stats->time_us, elapsed);
+    int_stats_add(&stats->histogram[bucket], 1);
+    if (!ret) {
+        int_stats_add(&stats->errors, 1);
+    }
+    return ret;
+}
+
+// Upper bound of the bucket holding the given fraction of the calls
+static uint64_t int_stats_percentile(struct webhook_stats_s *stats, uint64_t requests, int percent) {
+    uint64_t seen = 0;
+
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += __atomic_load_n(&stats->histogram[i], __ATOMIC_RELAXED);
+        if (seen * 100 >= requests * percent) {
+            return (uint64_t) 1 << i;
+        }
+    }
+    return (uint64_t) 1 << (STATS_BUCKETS - 1);
+}
+
+static void int_print_stats(int client, struct webhook_stats_s *stats) {
+    uint64_t requests = __atomic_load_n(&stats->requests, __ATOMIC_RELAXED);
+
+    if (!requests && !__atomic_load_n(&stats->errors, __ATOMIC_RELAXED)) {
+        return;
+    }
+    dprintf(client, "%s%s%s %llu %llu %llu %llu %llu %llu",
+            stats->subsystemname, stats->libfunction[0] ? "/" : "", stats->libfunction,
+            (unsigned long long) requests,
+            (unsigned long long) __atomic_load_n(&stats->errors, __ATOMIC_RELAXED),
+            (unsigned long long) __atomic_load_n(&stats->bytes_out, __ATOMIC_RELAXED),
+            (unsigned long long) __atomic_load_n(&stats->time_us, __ATOMIC_RELAXED),
+            (unsigned long long) int_stats_percentile(stats, requests, 50),
+            (unsigned long long) int_stats_percentile(stats, requests, 99));
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        dprintf(client, " %llu", (unsigned long long) __atomic_load_n(&stats->histogram[i], __ATOMIC_RELAXED));
+    }
+    dprintf(client, "\n");
+}
+
+static void int_send_stats(int client) {
+    dprintf(client, "# endpoint requests errors bytes_out time_us p50_us p99_us"
+                    " histogram of <1us <2us <4us ... us\n");
+    // the entries are added by this thread only, no lock is held while writing
+    for (int i = 0; i < STATS_SIZE; i++) {
+        if (endpoint_stats[i].subsystemname[0]) {
+            int_print_stats(client, &endpoint_stats[i]);
+        }
+    }
+    int_print_stats(client, &other_endpoint_stats);
+}
+
+// Framed as "<length>\n<reply>", so that multi-line replies can be told apart
+static int int_push_reply(int client, const char *reply, size_t len) {
+    char header[16];
+    int header_len = snprintf(header, sizeof(header), "%zu\n", len);
+    struct iovec iov[2] = {
+        {header, header_len},
+        {(void*) reply, len},
+    };
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    // a subscriber that can't keep up gets dropped instead of blocking us
+    return sendmsg(client, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t) (header_len + len);
+}
+
+// Returns 1 if it was the last subscriber of the feed and the feed is freed
+static int int_drop_subscriber(int idx) {
+    struct webhook_feed_s *feed = subscribers[idx].feed;
+    int feed_in_use = 0;
+
+    close(subscribers[idx].fd);
+    subscribers[idx] = subscribers[--subscribers_count];
+
+    feed->interval_ms = feed->pinned_interval_ms ? feed->pinned_interval_ms : UINT32_MAX;
+    for (int i = 0; i < subscribers_count; i++) {
+        if (subscribers[i].feed == feed) {
+            feed_in_use = 1;
+            if (subscribers[i].interval_ms < feed->interval_ms) {
+                feed->interval_ms = subscribers[i].interval_ms;
+            }
+        }
+    }
+    if (feed_in_use || feed->pinned_interval_ms) {
+        return 0;
+    }
+
+    for (int i = 0; i < MAX_FEEDS; i++) {
+        if (feeds[i] == feed) {
+            feeds[i] = NULL;
+        }
+    }
+    free(feed->last_reply);
+    free(feed);
+    return 1;
+}
+
+static int int_feed_has_subscribers(struct webhook_feed_s *feed) {
+    for (int i = 0; i < subscribers_count; i++) {
+        if (subscribers[i].feed == feed) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Calls the vendor hook and pushes the reply if it has changed since the last poll
+static void int_poll_feed(struct webhook_feed_s *feed) {
+    void *ret;
+    size_t len;
+
+    uint64_t now = now_ms();
+    feed->next_poll_ms = now + feed->interval_ms;
+
+    // a pinned feed is polled when waiting for the next check would be late
+    if (feed->pinned_interval_ms && feed->readers_interval_ms && !int_feed_has_subscribers(feed)) {
+        uint32_t readers_interval_ms = feed->readers_interval_ms();
+        if (!readers_interval_ms || now - feed->polled_ms + feed->pinned_interval_ms <= readers_interval_ms)
+            return;
+    }
+    feed->polled_ms = now;
+
+    ret = int_call_webfunc(feed->stats, feed->webfunc, feed->libfunction, feed->reqtype, feed->data);
+    if (!ret) {
+        return;
+    }
+    len = strlen(ret);
+
+    if (feed->last_reply && feed->last_reply_len == len && memcmp(feed->last_reply, ret, len) == 0) {
+        global_release_msg_real(ret);
+        if (feed->on_poll) {
+            feed->on_poll(feed, 0);
+        }
+        return;
+    }
+
+    free(feed->last_reply);
+    feed->last_reply = malloc(len + 1);
+    feed->last_reply_len = feed->last_reply ? len : 0;
+    if (feed->last_reply) {
+        memcpy(feed->last_reply, ret, len + 1);
+    }
+    global_release_msg_real(ret);
+
+    if (feed->on_poll && feed->last_reply) {
+        feed->on_poll(feed, 1);
+    }
+
+    for (int i = subscribers_count - 1; i >= 0; i--) {
+        if (subscribers[i].feed != feed) {
+            continue;
+        }
+        if (int_push_reply(subscribers[i].fd, feed->last_reply, feed->last_reply_len)) {
+            int_stats_add(&feed->stats->bytes_out, feed->last_reply_len);
+        } else if (int_drop_subscriber(i)) {
+            // nobody else is left to push to
+            return;
+        }
+    }
+}
+
+// Finds the feed for the same request or creates a new one
+static struct webhook_feed_s *int_get_feed(struct webhook_feed_s *key, uint32_t interval_ms) {
+    struct webhook_feed_s *feed;
+    int free_slot = -1;
+
+    for (int i = 0; i < MAX_FEEDS; i++) {
+        if (!feeds[i]) {
+            if (free_slot == -1)
+                free_slot = i;
+            continue;
+        }
+        feed = feeds[i];
+        if (feed->webfunc == key->webfunc && feed->reqtype == key->reqtype &&
+            strcmp(feed->libfunction, key->libfunction) == 0 &&
+            strcmp(feed->data, key->data) == 0) {
+            if (interval_ms < feed->interval_ms)
+                feed->interval_ms = interval_ms;
+            return feed;
+        }
+    }
+
+    if (free_slot == -1 || (feed = malloc(sizeof(*feed))) == NULL)
+        return NULL;
+    *feed = *key;
+    feed->interval_ms = interval_ms;
+    feed->next_poll_ms = 0;
+    feed->last_reply = NULL;
+    feed->last_reply_len = 0;
+    feed->stats = int_get_stats(feed->subsystemname, int_hash_name(feed->subsystemname), feed->libfunction);
+    feeds[free_slot] = feed;
+    return feed;
+}
+
+// Handles "@subscribe|<interval_ms>|<subsystem>|<function>|<reqtype>|<data>".
+// Returns 1 if the client was kept as a subscriber.
+static int int_subscribe(int client, char *request) {
+    struct webhook_feed_s key = {0};
+    struct webhook_feed_s *feed = NULL;
+    char *saveptr = NULL;
+    char *c_token;
+    uint32_t interval_ms;
+
+    if (subscribers_count >= MAX_SUBSCRIBERS)
+        return 0;
+
+    strtok_r(request, "|", &saveptr);
+    if ((c_token = strtok_r(NULL, "|", &saveptr)) == NULL)
+        return 0;
+    interval_ms = atoi(c_token);
+    if (interval_ms < MIN_FEED_INTERVAL_MS)
+        interval_ms = MIN_FEED_INTERVAL_MS;
+
+    if ((c_token = strtok_r(NULL, "|", &saveptr)) == NULL)
+        return 0;
+    strncpy(key.subsystemname, c_token, sizeof(key.subsystemname) - 1);
+    if ((key.webfunc = int_get_webhook(key.subsystemname, NULL)) == NULL) {
+        fprintf(stderr, "[int_subscribe] %s not found\n", key.subsystemname);
+        return 0;
+    }
+
+    if ((c_token = strtok_r(NULL, "|", &saveptr)) == NULL)
+        return 0;
+    strncpy(key.libfunction, c_token, sizeof(key.libfunction) - 1);
+
+    if ((c_token = strtok_r(NULL, "|", &saveptr)) == NULL)
+        return 0;
+    key.reqtype = atoi(c_token);
+
+    if ((c_token = strtok_r(NULL, "|", &saveptr)) == NULL)
+        return 0;
+    strncpy(key.data, c_token, sizeof(key.data) - 1);
+
+    if ((feed = int_get_feed(&key, interval_ms)) == NULL)
+        return 0;
+
+    subscribers[subscribers_count].fd = client;
+    subscribers[subscribers_count].interval_ms = interval_ms;
+    subscribers[subscribers_count].feed = feed;
+    subscribers_count++;
+
+    // the newcomer gets the current state straight away
+    if (feed->last_reply) {
+        if (int_push_reply(client, feed->last_reply, feed->last_reply_len))
+            int_stats_add(&feed->stats->bytes_out, feed->last_reply_len);
+        else
+            int_drop_subscriber(subscribers_count - 1);
+    } else {
+        int_poll_feed(feed);
+    }
+    return 1;
+}
+
+#ifdef METRICS_FILE
+// Publishing of the hottest metrics to the seqlock page, see device_metrics.h
+#define METRICS_INTERVAL_MS 1000
+// the missing sources are looked for again after 1, 2, 4... seconds up to this
+#define METRICS_SETUP_MAX_RETRY_MS (10 * 60 * 1000)
+
+static struct device_metrics *metrics_page = NULL;
+static struct webhook_feed_s *metrics_signal_feed = NULL;
+static struct webhook_feed_s *metrics_status_feed = NULL;
+static uint64_t metrics_setup_next_ms = 0;
+static uint32_t metrics_setup_retry_ms = METRICS_INTERVAL_MS;
+
+static struct vendor_xml_table metrics_signal_tags = VENDOR_XML_TABLE(DEVICE_SIGNAL_TAGS);
+static struct vendor_xml_table metrics_status_tags = VENDOR_XML_TABLE(DEVICE_STATUS_TAGS);
+
+static uint32_t int_metrics_readers_interval_ms() {
+    uint32_t interval_ms = __atomic_load_n(&metrics_page->read_interval_ms, __ATOMIC_RELAXED);
+
+    if (!device_metrics_has_readers(metrics_page))
+        return 0;
+    return interval_ms > METRICS_INTERVAL_MS ? interval_ms : METRICS_INTERVAL_MS;
+}
+
+// The page is stamped even if the signal is the same, so that the readers
+// can tell a stable signal from a stalled source
+static void int_metrics_signal_polled(struct webhook_feed_s *feed, int changed) {
+    struct device_metrics metrics = *metrics_page;
+    struct device_metrics *page = metrics_page;
+
+    if (!changed) {
+        device_metrics_write_begin(page);
+        device_metrics_write_end(page);
+        return;
+    }
+
+    device_metrics_clear_signal(&metrics);
+    // the CA state is only available through AT commands
+    metrics.ca = page->ca;
+    vendor_xml_parse_ints(&metrics_signal_tags, feed->last_reply, &metrics);
+
+    device_metrics_write_begin(page);
+    page->rssi = metrics.rssi;
+    page->rsrp = metrics.rsrp;
+    page->rsrq = metrics.rsrq;
+    page->sinr = metrics.sinr;
+    page->rscp = metrics.rscp;
+    page->ecio = metrics.ecio;
+    page->ul_bw = metrics.ul_bw;
+    page->dl_bw = metrics.dl_bw;
+    page->band = metrics.band;
+    page->ca = metrics.ca;
+    page->network_mode = metrics.network_mode;
+    device_metrics_write_end(page);
+}
+
+static void int_metrics_status_polled(struct webhook_feed_s *feed, int changed) {
+    struct device_metrics metrics;
+
+    if (!changed) {
+        return;
+    }
+
+    metrics.clients = -1;
+    vendor_xml_parse_ints(&metrics_status_tags, feed->last_reply, &metrics);
+
+    device_metrics_write_begin(metrics_page);
+    metrics_page->clients = metrics.clients;
+    device_metrics_write_end(metrics_page);
+}
+
+static struct device_metrics *int_map_metrics_page() {
+    struct device_metrics *page;
+    int fd = open(METRICS_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd == -1 || ftruncate(fd, sizeof(struct device_metrics)) == -1) {
+        perror("Can't create metrics page");
+        if (fd != -1)
+            close(fd);
+        return NULL;
+    }
+    page = mmap(NULL, sizeof(struct device_metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("Can't map metrics page");
+        return NULL;
+    }
+
+    device_metrics_write_begin(page);
+    page->magic = DEVICE_METRICS_MAGIC;
+    page->version = DEVICE_METRICS_VERSION;
+    device_metrics_clear_signal(page);
+    page->clients = -1;
+    device_metrics_write_end(page);
+    return page;
+}
+
+static struct webhook_feed_s *int_metrics_feed(const char *subsystemname, const char *libfunction,
+                                               void (*on_poll)(struct webhook_feed_s *feed, int changed)) {
+    struct webhook_feed_s key = {0};
+    struct webhook_feed_s *feed;
+
+    if ((key.webfunc = int_get_webhook(subsystemname, NULL)) == NULL)
+        return NULL;
+    strncpy(key.subsystemname, subsystemname, sizeof(key.subsystemname) - 1);
+    strncpy(key.libfunction, libfunction, sizeof(key.libfunction) - 1);
+    strcpy(key.data, "1");
+    key.reqtype = 1;
+
+    if ((feed = int_get_feed(&key, METRICS_INTERVAL_MS)) == NULL)
+        return NULL;
+    feed->pinned_interval_ms = METRICS_INTERVAL_MS;
+    feed->readers_interval_ms = int_metrics_readers_interval_ms;
+    feed->on_poll = on_poll;
+    return feed;
+}
+
+// The subsystems register one by one, so the feeds are created once they appear.
+// A subsystem may never come, the attempts back off exponentially. Returns
+// the ms until the next attempt while some of the sources are missing, -1
+// once all of them are there.
+static int int_metrics_setup(uint64_t now) {
+    if (metrics_page && metrics_signal_feed && metrics_status_feed)
+        return -1;
+    if (now < metrics_setup_next_ms)
+        return metrics_setup_next_ms - now;
+
+    if (!metrics_page)
+        metrics_page = int_map_metrics_page();
+    if (metrics_page && !metrics_signal_feed)
+        metrics_signal_feed = int_metrics_feed("device", "signal", int_metrics_signal_polled);
+    if (metrics_page && !metrics_status_feed)
+        metrics_status_feed = int_metrics_feed("monitoring", "status", int_metrics_status_polled);
+    if (metrics_page && metrics_signal_feed && metrics_status_feed)
+        return -1;
+
+    int retry_ms = metrics_setup_retry_ms;
+    metrics_setup_next_ms = now + retry_ms;
+    if (metrics_setup_retry_ms < METRICS_SETUP_MAX_RETRY_MS / 2)
+        metrics_setup_retry_ms *= 2;
+    else
+        metrics_setup_retry_ms = METRICS_SETUP_MAX_RETRY_MS;
+    return retry_ms;
+}
+#endif
+
+// Handles one "<subsystem>|<function>|<reqtype>|<data>" request.
+// Returns 1 if the client must be kept open.
+static int int_handle_request(int client, char *buf) {
     char subsystemname[32];
     char libfunction[64];
     char *c_token = NULL;
     int reqtype = 1;
     void* ret;
-    void* (*webfunc)(const char *function_name,
-                      int req_type_get_post,
-                      char *req_body,
-                      size_t req_size) = NULL;
+    webhook_func_t webfunc = NULL;
+    struct webhook_stats_s *stats;
+    uint32_t subsystem_hash;
+    int written;
+
+    if (strncmp(buf, WEBHOOK_SUBSCRIBE "|", strlen(WEBHOOK_SUBSCRIBE "|")) == 0) {
+        return int_subscribe(client, buf);
+    }
+    if (strcmp(buf, WEBHOOK_STATS) == 0) {
+        int_send_stats(client);
+        return 0;
+    }
+
+    if ((c_token = strtok(buf, "|")) == NULL)
+        return 0;
+    strncpy(subsystemname, c_token, sizeof(subsystemname) - 1);
+    subsystemname[sizeof(subsystemname) - 1] = '\0';
+    if ((webfunc = int_get_webhook(subsystemname, &subsystem_hash)) == NULL) {
+        fprintf(stderr, "[web_hookserver] %s not found\n", subsystemname);
+        int_stats_add(&other_endpoint_stats.errors, 1);
+        return 0;
+    }
+
+    if ((c_token = strtok(NULL, "|")) == NULL)
+        return 0;
+    strncpy(libfunction, c_token, sizeof(libfunction) - 1);
+    libfunction[sizeof(libfunction) - 1] = '\0';
+
+    if ((c_token = strtok(NULL, "|")) == NULL)
+        return 0;
+    reqtype = atoi(c_token);
+
+    if ((c_token = strtok(NULL, "|")) == NULL)
+        return 0;
+    stats = int_get_stats(subsystemname, subsystem_hash, libfunction);
+    ret = int_call_webfunc(stats, webfunc, libfunction, reqtype, c_token);
+    if (ret) {
+        if ((written = dprintf(client, "%s\n", (char*) ret)) > 0) {
+            int_stats_add(&stats->bytes_out, written);
+        } else {
+            int_stats_add(&stats->errors, 1);
+        }
+        global_release_msg_real(ret);
+    }
+    return 0;
+}
+
+// Socket server handler. Vendor hooks are only ever called from this thread.
+static void* web_hookserver(void* nothing) {
+    int fd, client;
+    ssize_t rsize;
+    char buf[BUFSIZE];
+    struct pollfd pfds[MAX_SUBSCRIBERS + 1];
 
     fd = create_socket(SOCK_NAME);
     fprintf(stderr, "Created socket\n");
 
     for (;;) {
-        if ((client = accept(fd, NULL, NULL)) == -1) {
-            continue;
+        uint64_t now = now_ms();
+        int timeout = -1;
+
+#ifdef METRICS_FILE
+        timeout = int_metrics_setup(now);
+#endif
+
+        for (int i = 0; i < MAX_FEEDS; i++) {
+            if (!feeds[i])
+                continue;
+            if (feeds[i]->next_poll_ms <= now) {
+                timeout = 0;
+            } else if (timeout == -1 || feeds[i]->next_poll_ms - now < (uint64_t) timeout) {
+                timeout = feeds[i]->next_poll_ms - now;
+            }
         }
-        while ((rsize=read(client, buf, sizeof(buf) - 2)) > 0) {
-            buf[rsize] = '\0';
-            buf[strcspn(buf, "\r\n")] = '\0';
-
-            if ((c_token = strtok(buf, "|")) != NULL) {
-                strncpy(subsystemname, c_token, sizeof(subsystemname) - 1);
-                subsystemname[sizeof(subsystemname) - 1] = '\0';
-                if (!int_get_webhook(subsystemname)) {
-                    close(client);
-                    continue;
-                }
-                webfunc = int_get_webhook(subsystemname);
 
-                if ((c_token = strtok(NULL, "|")) == NULL) {
-                    close(client);
-                    continue;
-                }
-                strncpy(libfunction, c_token, sizeof(libfunction) - 1);
-                libfunction[sizeof(libfunction) - 1] = '\0';
+        pfds[0].fd = fd;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < subscribers_count; i++) {
+            pfds[i + 1].fd = subscribers[i].fd;
+            pfds[i + 1].events = POLLIN;
+        }
 
-                if ((c_token = strtok(NULL, "|")) == NULL) {
-                    close(client);
-                    continue;
+        if (poll(pfds, subscribers_count + 1, timeout) > 0) {
+            // subscribers aren't expected to talk, so input means they are gone
+            for (int i = subscribers_count - 1; i >= 0; i--) {
+                if (pfds[i + 1].revents && read(subscribers[i].fd, buf, sizeof(buf)) <= 0) {
+                    int_drop_subscriber(i);
                 }
-                reqtype = 1;
-                reqtype = atoi(c_token);
+            }
 
-                if ((c_token = strtok(NULL, "|")) == NULL) {
+            if ((pfds[0].revents & POLLIN) && (client = accept(fd, NULL, NULL)) != -1) {
+                if ((rsize = read(client, buf, sizeof(buf) - 2)) > 0) {
+                    buf[rsize] = '\0';
+                    buf[strcspn(buf, "\r\n")] = '\0';
+                    if (!int_handle_request(client, buf)) {
+                        close(client);
+                    }
+                } else {
                     close(client);
-                    continue;
-                }
-                ret = webfunc(libfunction, reqtype, c_token, strlen(c_token));
-                if (ret) {
-                    dprintf(client, "%s\n", ret);
-                    global_release_msg_real(ret);
                 }
-                close(client);
             }
         }
-        close(client);
+
+        now = now_ms();
+        for (int i = 0; i < MAX_FEEDS; i++) {
+            if (feeds[i] && feeds[i]->next_poll_ms <= now) {
+                int_poll_feed(feeds[i]);
+            }
+        }
     }
     return 0;
 }
@@ -192,11 +877,15 @@ void* webserver_register_hookfunction(int subsystemnum, const char *subsystemnam
     unsetenv("LD_PRELOAD");
 
     if (!webserver_r_h_real) {
+#ifdef BENCH
+        webserver_r_h_real = bench_register_hookfunction_real;
+#else
         webserver_r_h_real = dlsym(RTLD_NEXT, "webserver_register_hookfunction");
+#endif
     }
 
     fprintf(stderr, "Trying to search for webhook %s\n", subsystemname);
-    if (!int_get_webhook(subsystemname)) {
+    if (!int_get_webhook(subsystemname, NULL)) {
         fprintf(stderr, "Webhook not found, registering\n");
         int_register_webhook(subsystemname, hookfunction);
         fprintf(stderr, "Registered\n");
@@ -239,6 +928,268 @@ ssize_t readlink(const char *pathname, char *buf, size_t bufsiz) {
 
 #endif
 
+// Building the benchmark, the server is the hook code above
+#ifdef BENCH
+#include <errno.h>
+#include <getopt.h>
+
+enum bench_request_type {
+    BENCH_SMALL,
+    BENCH_LARGE,
+    BENCH_SLOW,
+    BENCH_MISSING,
+    BENCH_REQUEST_TYPES
+};
+
+static const char *bench_request_names[BENCH_REQUEST_TYPES] = {"small", "large", "slow", "missing"};
+
+static size_t bench_small_reply_size = 256;
+static size_t bench_large_reply_size = 4096;
+static useconds_t bench_fast_latency_us = 100;
+static useconds_t bench_slow_latency_us = 20000;
+static int bench_weights[BENCH_REQUEST_TYPES] = {70, 15, 10, 5};
+
+struct bench_thread_s {
+    pthread_t thread;
+    unsigned int seed;
+    uint64_t deadline_ms;
+    uint32_t *latencies_us;
+    size_t latencies_count;
+    size_t latencies_size;
+    uint64_t requests[BENCH_REQUEST_TYPES];
+    uint64_t refused;
+    uint64_t failed;
+    uint64_t bytes;
+};
+
+static void* bench_register_hookfunction_real(int subsystemnum, const char *subsystemname,
+                                              void* hookfunction, void* global_release_msg) {
+    return NULL;
+}
+
+static void bench_release_msg(void *ptr) {
+    free(ptr);
+}
+
+static void* bench_reply(size_t size, useconds_t latency_us) {
+    char *ret = malloc(size + 1);
+
+    if (latency_us)
+        usleep(latency_us);
+    if (ret) {
+        memset(ret, 'x', size);
+        ret[size] = '\0';
+    }
+    return ret;
+}
+
+static void* bench_small_hook(const char *function_name, int req_type_get_post,
+                              char *req_body, size_t req_size) {
+    return bench_reply(bench_small_reply_size, bench_fast_latency_us);
+}
+
+static void* bench_large_hook(const char *function_name, int req_type_get_post,
+                              char *req_body, size_t req_size) {
+    return bench_reply(bench_large_reply_size, bench_fast_latency_us);
+}
+
+static void* bench_slow_hook(const char *function_name, int req_type_get_post,
+                             char *req_body, size_t req_size) {
+    return bench_reply(bench_small_reply_size, bench_slow_latency_us);
+}
+
+static void bench_record(struct bench_thread_s *t, uint32_t latency_us) {
+    if (t->latencies_count == t->latencies_size) {
+        size_t new_size = t->latencies_size ? t->latencies_size * 2 : 4096;
+        uint32_t *latencies = realloc(t->latencies_us, new_size * sizeof(uint32_t));
+        if (!latencies)
+            return;
+        t->latencies_us = latencies;
+        t->latencies_size = new_size;
+    }
+    t->latencies_us[t->latencies_count++] = latency_us;
+}
+
+static enum bench_request_type bench_pick_type(struct bench_thread_s *t) {
+    int total = 0;
+    int pick;
+
+    for (int i = 0; i < BENCH_REQUEST_TYPES; i++)
+        total += bench_weights[i];
+    pick = rand_r(&t->seed) % total;
+    for (int i = 0; i < BENCH_REQUEST_TYPES; i++) {
+        if (pick < bench_weights[i])
+            return i;
+        pick -= bench_weights[i];
+    }
+    return BENCH_SMALL;
+}
+
+// One request per connection, like the real clients
+static void* bench_client(void* arg) {
+    struct bench_thread_s *t = arg;
+    struct sockaddr_un addr;
+    char buf[BUFSIZE];
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCK_NAME);
+
+    while (now_ms() < t->deadline_ms) {
+        enum bench_request_type type = bench_pick_type(t);
+        struct timespec start, end;
+        ssize_t rsize;
+        size_t total = 0;
+        int fd;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+            t->failed++;
+            continue;
+        }
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+            if (errno == ECONNREFUSED || errno == EAGAIN)
+                t->refused++;
+            else
+                t->failed++;
+            close(fd);
+            continue;
+        }
+
+        dprintf(fd, "%s|bench|1|1\n", type == BENCH_MISSING ? "missing" : bench_request_names[type]);
+        while ((rsize = read(fd, buf, sizeof(buf))) > 0)
+            total += rsize;
+        close(fd);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (rsize < 0 || (type != BENCH_MISSING && total == 0)) {
+            t->failed++;
+            continue;
+        }
+        t->requests[type]++;
+        t->bytes += total;
+        bench_record(t, (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+    }
+    return NULL;
+}
+
+static int bench_compare_latencies(const void *a, const void *b) {
+    uint32_t la = *(const uint32_t*) a;
+    uint32_t lb = *(const uint32_t*) b;
+    return (la > lb) - (la < lb);
+}
+
+static void bench_usage() {
+    puts("Usage: webhook_bench [options]\n"
+         "  -t <threads>         client threads (8)\n"
+         "  -d <seconds>         duration (5)\n"
+         "  -s <bytes>           small reply size (256)\n"
+         "  -S <bytes>           large reply size (4096)\n"
+         "  -l <us>              fast hook latency (100)\n"
+         "  -L <us>              slow hook latency (20000)\n"
+         "  -m <s:l:w:m>         request mix weights of small, large, slow\n"
+         "                       and missing subsystem requests (70:15:10:5)");
+}
+
+int main(int argc, char* argv[]) {
+    int threads_count = 8;
+    int duration_s = 5;
+    struct bench_thread_s *threads;
+    uint64_t requests[BENCH_REQUEST_TYPES] = {0};
+    uint64_t refused = 0, failed = 0, bytes = 0;
+    size_t latencies_count = 0;
+    uint32_t *latencies;
+    uint64_t start_ms, elapsed_ms;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:d:s:S:l:L:m:h")) != -1) {
+        switch (opt) {
+        case 't': threads_count = atoi(optarg); break;
+        case 'd': duration_s = atoi(optarg); break;
+        case 's': bench_small_reply_size = atoi(optarg); break;
+        case 'S': bench_large_reply_size = atoi(optarg); break;
+        case 'l': bench_fast_latency_us = atoi(optarg); break;
+        case 'L': bench_slow_latency_us = atoi(optarg); break;
+        case 'm':
+            if (sscanf(optarg, "%d:%d:%d:%d", &bench_weights[0], &bench_weights[1],
+                       &bench_weights[2], &bench_weights[3]) != 4) {
+                bench_usage();
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            bench_usage();
+            exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (threads_count < 1 || duration_s < 1 ||
+        bench_weights[0] + bench_weights[1] + bench_weights[2] + bench_weights[3] <= 0) {
+        bench_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    // the vendor web server registers the hooks the same way, this starts the server
+    webserver_register_hookfunction(0, "small", bench_small_hook, bench_release_msg);
+    webserver_register_hookfunction(1, "large", bench_large_hook, bench_release_msg);
+    webserver_register_hookfunction(2, "slow", bench_slow_hook, bench_release_msg);
+    while (access(SOCK_NAME, F_OK) == -1)
+        usleep(1000);
+    usleep(10000);
+
+    threads = calloc(threads_count, sizeof(struct bench_thread_s));
+    start_ms = now_ms();
+    for (int i = 0; i < threads_count; i++) {
+        threads[i].seed = i + 1;
+        threads[i].deadline_ms = start_ms + duration_s * 1000;
+        if (pthread_create(&threads[i].thread, NULL, bench_client, &threads[i])) {
+            perror("Error creating thread.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < threads_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+        for (int type = 0; type < BENCH_REQUEST_TYPES; type++)
+            requests[type] += threads[i].requests[type];
+        refused += threads[i].refused;
+        failed += threads[i].failed;
+        bytes += threads[i].bytes;
+        latencies_count += threads[i].latencies_count;
+    }
+    elapsed_ms = now_ms() - start_ms;
+
+    latencies = malloc((latencies_count + 1) * sizeof(uint32_t));
+    latencies_count = 0;
+    for (int i = 0; i < threads_count; i++) {
+        memcpy(latencies + latencies_count, threads[i].latencies_us,
+               threads[i].latencies_count * sizeof(uint32_t));
+        latencies_count += threads[i].latencies_count;
+        free(threads[i].latencies_us);
+    }
+    qsort(latencies, latencies_count, sizeof(uint32_t), bench_compare_latencies);
+
+    printf("threads: %d, duration: %llu ms\n", threads_count, (unsigned long long) elapsed_ms);
+    for (int type = 0; type < BENCH_REQUEST_TYPES; type++)
+        printf("%s requests: %llu\n", bench_request_names[type], (unsigned long long) requests[type]);
+    printf("throughput: %.1f req/s, %.1f KB/s\n",
+           latencies_count * 1000.0 / elapsed_ms, bytes / 1.024 / elapsed_ms);
+    if (latencies_count) {
+        printf("latency p50: %u us, p99: %u us, max: %u us\n",
+               latencies[latencies_count / 2], latencies[latencies_count * 99 / 100],
+               latencies[latencies_count - 1]);
+    }
+    printf("refused connections: %llu, failed requests: %llu\n",
+           (unsigned long long) refused, (unsigned long long) failed);
+
+    free(latencies);
+    free(threads);
+    unlink(SOCK_NAME);
+    return 0;
+}
+#endif
+
 // Building web_hook_client
 #ifdef CLIENT
 static int open_socket(char* path) {
@@ -261,15 +1212,70 @@ static int open_socket(char* path) {
     return fd;
 }
 
+// Prints every pushed reply until the hook closes the subscription
+static int subscribe(int argc, char* argv[]) {
+    FILE *f;
+    size_t len;
+    char buf[BUFSIZE];
+
+    if (argc != 7) {
+        puts("Need 5 arguments after -s: <interval_ms> <subsystemname> <funcname> <1 for get, 2 for post> <data>");
+        exit(EXIT_FAILURE);
+    }
+
+    f = fdopen(open_socket(SOCK_NAME), "r+");
+    fprintf(f, WEBHOOK_SUBSCRIBE "|%s|%s|%s|%s|%s\n", argv[2], argv[3], argv[4], argv[5], argv[6]);
+    fflush(f);
+
+    while (fscanf(f, "%zu\n", &len) == 1 && len < sizeof(buf)) {
+        if (fread(buf, 1, len, f) != len) {
+            break;
+        }
+        buf[len] = '\0';
+        puts(buf);
+        fflush(stdout);
+    }
+    fclose(f);
+
+    return 0;
+}
+
+// The statistics may not fit in one read, unlike the replies
+static int print_stats() {
+    int fd;
+    ssize_t rsize;
+    char buf[BUFSIZE];
+
+    alarm(60);
+
+    fd = open_socket(SOCK_NAME);
+    dprintf(fd, WEBHOOK_STATS "\n");
+    while ((rsize = read(fd, buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, rsize, stdout);
+    }
+    close(fd);
+
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     int fd;
     ssize_t rsize;
     char buf[BUFSIZE];
 
+    if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+        return subscribe(argc, argv);
+    }
+    if (argc == 2 && strcmp(argv[1], "-S") == 0) {
+        return print_stats();
+    }
+
     alarm(60);
 
     if (argc != 5) {
         puts("Need 4 arguments: <subsystemname> <funcname> <1 for get, 2 for post> <data>");
+        puts("or -s <interval_ms> <subsystemname> <funcname> <1 for get, 2 for post> <data> to subscribe");
+        puts("or -S to print the per endpoint statistics");
         exit(EXIT_FAILURE);
     }
 
@@ -0,0 +1,25 @@
+#ifndef WEB_HOOK_H
+#define WEB_HOOK_H
+
+/*
+ * Wire protocol of the web functions hook socket, shared by web_hook.c and
+ * its users in the OLED library.
+ *
+ * Plain request, answered with the reply and closed:
+ *   <subsystem>|<function>|<1 for get, 2 for post>|<data>\n
+ *
+ * Subscription, kept open. The reply is pushed as "<length>\n<reply>" right
+ * away and then every time it changes, polled at <interval_ms>:
+ *   @subscribe|<interval_ms>|<subsystem>|<function>|<1 for get, 2 for post>|<data>\n
+ *
+ * Statistics, one line per "<subsystem>/<function>" endpoint, then closed:
+ *   @stats\n
+ */
+
+#define WEBHOOK_SUBSCRIBE "@subscribe"
+#define WEBHOOK_STATS "@stats"
+
+#define DEVICE_WEBHOOK_SOCK "/var/device_webhook"
+#define SMS_WEBHOOK_SOCK "/var/sms_webhook"
+
+#endif